@@ -0,0 +1,181 @@
+#define _GNU_SOURCE // accept4
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "management/metrics.h"
+
+/** período de la medición del atraso del loop */
+#define PROBE_INTERVAL_MS 100
+/** con este atraso promedio empezamos a rechazar... */
+#define LAG_SHED_MS 100
+/** ...y dejamos de hacerlo por debajo de este */
+#define LAG_RECOVER_MS 50
+/** sesiones negociando a partir de las cuales se rechazan las nuevas */
+#define MAX_HANDSHAKES 512
+/** cada cuánto se reevalúa un listener pausado */
+#define RESUME_CHECK_MS 100
+/** un listener pausado se reanuda al cerrarse esta fracción de sesiones... */
+#define RESUME_FRACTION 10
+/** ...o al menos estas, si hay pocas... */
+#define RESUME_MIN_CLOSED 8
+/** ...o pasado este tiempo, por si los fds se liberaron por otro lado */
+#define MAX_PAUSE_MS 1000
+
+static fd_selector selector = NULL;
+static int listener_fd = -1;
+static int reserve_fd = -1;
+
+static unsigned sessions = 0;
+static unsigned handshakes = 0;
+
+static uint64_t probe_deadline = 0; // ns
+static uint64_t lag_avg = 0;        // ns
+static bool lagging = false;
+
+static metric_id shed_connections = METRIC_INVALID;
+static metric_id listener_pauses = METRIC_INVALID;
+
+static bool paused = false;
+static unsigned sessions_at_pause = 0;
+static uint64_t paused_since = 0;
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void open_reserve(void) {
+  if (reserve_fd < 0) {
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  }
+}
+
+// El timer vence en la primera iteración posterior al plazo: lo que se pasó
+// es lo que tardó el loop en volver a atender timers
+static void probe_tick(fd_selector s, void *data) {
+  (void)data;
+  uint64_t now = monotonic_ns();
+  uint64_t lag = now > probe_deadline ? now - probe_deadline : 0;
+  lag_avg = (lag_avg * 3 + lag) / 4;
+
+  uint64_t lag_ms = lag_avg / 1000000;
+  if (!lagging && lag_ms >= LAG_SHED_MS) {
+    lagging = true;
+    fprintf(stderr, "admission: event loop lagging %llu ms, shedding\n",
+            (unsigned long long)lag_ms);
+  } else if (lagging && lag_ms < LAG_RECOVER_MS) {
+    lagging = false;
+    fprintf(stderr, "admission: event loop recovered\n");
+  }
+
+  probe_deadline = now + PROBE_INTERVAL_MS * 1000000ULL;
+  selector_timer_add(s, PROBE_INTERVAL_MS, probe_tick, NULL);
+}
+
+bool admission_init(fd_selector s, int listener) {
+  selector = s;
+  listener_fd = listener;
+  shed_connections = metrics_register_counter("shed connections");
+  listener_pauses = metrics_register_counter("listener pauses");
+  metrics_register_gauge("handshakes in progress", admission_handshakes);
+  metrics_register_gauge("event loop lag ms", admission_loop_lag_ms);
+  open_reserve();
+  probe_deadline = monotonic_ns() + PROBE_INTERVAL_MS * 1000000ULL;
+  return reserve_fd >= 0 &&
+         selector_timer_add(s, PROBE_INTERVAL_MS, probe_tick, NULL) != 0;
+}
+
+bool admission_should_shed(void) {
+  return lagging || handshakes >= MAX_HANDSHAKES;
+}
+
+void admission_reject(int fd) {
+  // Descartamos lo que haya mandado el cliente (con defer accept suele estar
+  // el saludo): cerrar con datos sin leer manda RST en lugar de FIN
+  uint8_t discard[512];
+  while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+  }
+  static const uint8_t no_methods[] = {0x05, 0xFF};
+  send(fd, no_methods, sizeof(no_methods), MSG_NOSIGNAL | MSG_DONTWAIT);
+  close(fd);
+  metrics_add(shed_connections, 1);
+}
+
+static void resume_check(fd_selector s, void *data);
+
+void admission_fd_exhausted(void) {
+  // Con el fd de reserva liberado podemos sacar una conexión de la cola y
+  // rechazarla, en vez de dejarla colgada hasta que el cliente se canse
+  if (reserve_fd >= 0) {
+    close(reserve_fd);
+    reserve_fd = -1;
+    int fd = accept4(listener_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd >= 0) {
+      admission_reject(fd);
+    }
+    open_reserve();
+  }
+
+  if (!paused) {
+    paused = true;
+    sessions_at_pause = sessions;
+    paused_since = monotonic_ns();
+    selector_set_interest(selector, listener_fd, OP_NOOP);
+    metrics_add(listener_pauses, 1);
+    fprintf(stderr, "admission: out of file descriptors with %u sessions, "
+                    "pausing accept\n",
+            sessions);
+    selector_timer_add(selector, RESUME_CHECK_MS, resume_check, NULL);
+  }
+}
+
+static void resume_check(fd_selector s, void *data) {
+  (void)data;
+  // sin reserva seguimos sin fds
+  open_reserve();
+
+  unsigned margin = sessions_at_pause / RESUME_FRACTION;
+  if (margin < RESUME_MIN_CLOSED) {
+    margin = RESUME_MIN_CLOSED;
+  }
+  bool drained = sessions + margin <= sessions_at_pause;
+  bool expired = monotonic_ns() - paused_since >= MAX_PAUSE_MS * 1000000ULL;
+  if (reserve_fd >= 0 && (drained || expired)) {
+    paused = false;
+    selector_set_interest(s, listener_fd, OP_READ);
+    fprintf(stderr, "admission: resuming accept with %u sessions\n",
+            sessions);
+    return;
+  }
+  selector_timer_add(s, RESUME_CHECK_MS, resume_check, NULL);
+}
+
+void admission_session_opened(void) {
+  sessions++;
+  handshakes++;
+}
+
+void admission_handshake_done(void) {
+  if (handshakes > 0) {
+    handshakes--;
+  }
+}
+
+void admission_session_closed(bool handshaking) {
+  if (sessions > 0) {
+    sessions--;
+  }
+  if (handshaking) {
+    admission_handshake_done();
+  }
+}
+
+uint64_t admission_handshakes(void) { return handshakes; }
+
+uint64_t admission_loop_lag_ms(void) { return lag_avg / 1000000; }
@@ -0,0 +1,47 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "lib/selector.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * admission.c - control de admisión del listener SOCKS
+ *
+ * Protege a las sesiones en curso cuando el servidor está sobrecargado:
+ *
+ * - Sin file descriptors (EMFILE/ENFILE) el listener seguiría legible y el
+ *   loop giraría sin parar. Usamos un fd de reserva para aceptar y rechazar
+ *   limpiamente la conexión pendiente, y pausamos el listener hasta que se
+ *   cierre una fracción de las sesiones.
+ *
+ * - Con el loop atrasado (medido con un timer del selector) o demasiadas
+ *   sesiones negociando a la vez, las conexiones nuevas se rechazan apenas
+ *   se aceptan, antes de que compitan con las que ya están copiando.
+ *
+ * Sólo desde el hilo del selector.
+ */
+
+/** abre el fd de reserva y arranca la medición del atraso del loop */
+bool admission_init(fd_selector s, int listener);
+
+/** true si hay que rechazar las conexiones nuevas */
+bool admission_should_shed(void);
+
+/** rechaza `fd' recién aceptado: contesta sin métodos aceptables y cierra */
+void admission_reject(int fd);
+
+/** accept falló por falta de fds: rechaza una conexión y pausa el listener */
+void admission_fd_exhausted(void);
+
+/** ciclo de vida de las sesiones, para contar las que están negociando */
+void admission_session_opened(void);
+void admission_handshake_done(void);
+void admission_session_closed(bool handshaking);
+
+/** sesiones entre el accept y la etapa de copia */
+uint64_t admission_handshakes(void);
+/** atraso promedio del loop en milisegundos */
+uint64_t admission_loop_lag_ms(void);
+
+#endif
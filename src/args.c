@@ -4,6 +4,7 @@
 #include <stdio.h>  /* for printf */
 #include <stdlib.h> /* for exit */
 #include <string.h> /* memset */
+#include <sys/socket.h> /* SOMAXCONN */
 
 #include "args.h"
 
@@ -48,13 +49,26 @@ static void usage(const char *progname) {
       stderr,
       "Usage: %s [OPTION]...\n"
       "\n"
+      "   -b <backlog>     Conexiones SOCKS pendientes de aceptar. Por "
+      "defecto SOMAXCONN.\n"
+      "   -C <bytes/s>     Capacidad de salida a repartir entre sesiones.\n"
       "   -h               Imprime la ayuda y termina.\n"
       "   -l <SOCKS addr>  Dirección donde servirá el proxy SOCKS.\n"
       "   -L <conf  addr>  Dirección donde servirá el servicio de management.\n"
+      "   -O <leg>:<opt>=<valor>\n"
+      "                    Opción de socket para los clientes (client) o los\n"
+      "                    orígenes (origin). Ver SET_SOCKOPT.\n"
       "   -p <SOCKS port>  Puerto entrante conexiones SOCKS.\n"
       "   -P <conf port>   Puerto entrante conexiones configuracion\n"
       "   -u <name>:<pass> Usuario y contraseña de usuario que puede usar el "
       "proxy. Hasta 10.\n"
+      "   -S <archivo>     Página de métricas para socks5stat. Por defecto\n"
+      "                    /dev/shm/socks5d-<SOCKS port>.stats.\n"
+      "   -T <cidr>[=id]   Red de confianza: sus clientes pueden usar NO_AUTH "
+      "y quedan\n"
+      "                    identificados como <id>. Hasta 16.\n"
+      "   -U <archivo>     Base de usuarios generada con mkuserdb. Se recarga "
+      "al reemplazarse.\n"
       "   -v               Imprime información sobre la versión versión y "
       "termina.\n"
 
@@ -70,6 +84,7 @@ void parse_args(const int argc, char **argv, struct socks5args *args) {
   args->socks_addr =
       "::"; // ANTES DECIA 0.0.0.0 PERO SOLO ACEPTABA CONECCIONES IPV4
   args->socks_port = 1080;
+  args->backlog = SOMAXCONN;
 
   args->mng_addr = "127.0.0.1";
   args->mng_port = 8080;
@@ -78,16 +93,41 @@ void parse_args(const int argc, char **argv, struct socks5args *args) {
 
   int c;
   int nusers = 0;
+  int ntrusted = 0;
+  int nsockopts = 0;
 
   while (true) {
     int option_index = 0;
     static struct option long_options[] = {{0, 0, 0, 0}};
 
-    c = getopt_long(argc, argv, "hl:L:Np:P:u:v", long_options, &option_index);
+    c = getopt_long(argc, argv, "b:C:hl:L:NO:p:P:S:T:u:U:v", long_options, &option_index);
     if (c == -1)
       break;
 
     switch (c) {
+    case 'b': {
+      char *end;
+      errno = 0;
+      long backlog = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || errno == ERANGE || backlog <= 0 ||
+          backlog > INT_MAX) {
+        fprintf(stderr, "invalid backlog: %s\n", optarg);
+        exit(1);
+      }
+      args->backlog = backlog;
+      break;
+    }
+    case 'C': {
+      char *end;
+      errno = 0;
+      args->capacity = strtoull(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || errno == ERANGE ||
+          optarg[0] == '-') {
+        fprintf(stderr, "invalid capacity: %s\n", optarg);
+        exit(1);
+      }
+      break;
+    }
     case 'h':
       usage(argv[0]);
       break;
@@ -100,12 +140,31 @@ void parse_args(const int argc, char **argv, struct socks5args *args) {
     case 'N':
       args->disectors_enabled = false;
       break;
+    case 'O':
+      if (nsockopts >= MAX_SOCKOPTS) {
+        fprintf(stderr, "maximun number of socket options reached: %d.\n",
+                MAX_SOCKOPTS);
+        exit(1);
+      }
+      args->sockopts[nsockopts++] = optarg;
+      break;
     case 'p':
       args->socks_port = port(optarg);
       break;
     case 'P':
       args->mng_port = port(optarg);
       break;
+    case 'S':
+      args->statspage_path = optarg;
+      break;
+    case 'T':
+      if (ntrusted >= MAX_TRUSTED) {
+        fprintf(stderr, "maximun number of trusted networks reached: %d.\n",
+                MAX_TRUSTED);
+        exit(1);
+      }
+      args->trusted[ntrusted++] = optarg;
+      break;
     case 'u':
       if (nusers >= MAX_USERS) {
         fprintf(stderr, "maximun number of command line users reached: %d.\n",
@@ -116,6 +175,9 @@ void parse_args(const int argc, char **argv, struct socks5args *args) {
         nusers++;
       }
       break;
+    case 'U':
+      args->userdb_path = optarg;
+      break;
     case 'v':
       version();
       exit(0);
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 
 #define MAX_USERS 10
+#define MAX_TRUSTED 16
+#define MAX_SOCKOPTS 32
 
 struct users
 {
@@ -15,6 +17,8 @@ struct socks5args
 {
     char* socks_addr;
     unsigned short socks_port;
+    /** largo de la cola de conexiones pendientes del listener SOCKS (-b) */
+    int backlog;
 
     char* mng_addr;
     unsigned short mng_port;
@@ -22,6 +26,22 @@ struct socks5args
     bool disectors_enabled;
 
     struct users users[MAX_USERS];
+
+    /** base de usuarios generada con mkuserdb (-U), o NULL */
+    char* userdb_path;
+
+    /** página de métricas en memoria compartida (-S), o NULL para la de
+     * por defecto */
+    char* statspage_path;
+
+    /** capacidad de salida compartida en bytes/s (-C), 0 = sin límite */
+    unsigned long long capacity;
+
+    /** redes de confianza `cidr[=nombre]' (-T) que pueden usar NO_AUTH */
+    char* trusted[MAX_TRUSTED];
+
+    /** opciones de socket `extremo:opción=valor' (-O) */
+    char* sockopts[MAX_SOCKOPTS];
 };
 
 /**
@@ -20,8 +20,21 @@ void interactive_mode(int sock) {
   printf("Available commands: \n\t METRICS: Print server metrics \n\t ADD_USER "
          "<username>:<password>: Add a new user  \n\t DEL_USER <username>: "
          "Delete a user \n\t LIST_USERS: List all users\n\t SHOW_LOGS: Show "
-         "server logs\n\t SET_BUFFER <size>: Set buffer size\n\t QUIT: Exit "
-         "the session\n\n");
+         "server logs\n\t SET_BUFFER <size>: Set buffer size\n\t ADD_HOST "
+         "<host>=<ip>[,<ip>]: Add a static host\n\t DEL_HOST <host>: Delete a "
+         "static host\n\t LIST_HOSTS: List static hosts\n\t SET_LIMIT "
+         "<user|*>:<max_sessions>:<bytes_per_sec>[:<weight>]: Set user limits "
+         "(0 = unlimited)\n\t LIST_LIMITS: List user limits\n\t "
+         "SET_CAPACITY <bytes_per_sec>: Set shared egress capacity\n\t "
+         "SET_SOCKOPT <client|origin>:<option>=<value|default>: Tune new "
+         "sockets\n\t LIST_SOCKOPTS: List socket options\n\t "
+         "TOP_DESTINATIONS [count]: Busiest destinations\n\t TOP_USERS "
+         "[count]: Busiest users\n\t METRICS_HISTORY <window>: Traffic "
+         "history (e.g. 90s, 6h)\n\t LIST_SESSIONS [user=<u>] [state=<s>] "
+         "[age=<secs>] [bytes=<n>] [after=<id>] [limit=<n>]: List live "
+         "sessions\n\t KILL_SESSION <id>: Close a session\n\t UNIQUES: Distinct "
+         "clients and destinations\n\t QUIT: Exit the "
+         "session\n\n");
   printf("-----------------------------------------------------------------\n");
 
   while (1) {
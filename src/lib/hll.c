@@ -0,0 +1,62 @@
+#include <math.h>
+#include <string.h>
+
+#include "hll.h"
+
+static uint64_t hash(const void *data, size_t len) {
+  // FNV-1a sobre los bytes...
+  const unsigned char *p = data;
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 1099511628211ULL;
+  }
+  // ...y el final de MurmurHash3 para que los bits altos, que eligen el
+  // registro, dependan de todos los bytes
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void hll_clear(struct hll *h) { memset(h->registers, 0, sizeof(h->registers)); }
+
+void hll_add(struct hll *h, const void *data, size_t len) {
+  uint64_t x = hash(data, len);
+  unsigned index = x >> (64 - HLL_PRECISION);
+  uint64_t rest = x << HLL_PRECISION;
+  // posición del primer uno en lo que queda; todo ceros cuenta como el máximo
+  uint8_t rank =
+      rest == 0 ? 64 - HLL_PRECISION + 1 : __builtin_clzll(rest) + 1;
+  if (rank > h->registers[index]) {
+    h->registers[index] = rank;
+  }
+}
+
+void hll_merge(struct hll *dst, const struct hll *src) {
+  for (size_t i = 0; i < HLL_REGISTERS; i++) {
+    if (src->registers[i] > dst->registers[i]) {
+      dst->registers[i] = src->registers[i];
+    }
+  }
+}
+
+uint64_t hll_count(const struct hll *h) {
+  const double m = HLL_REGISTERS;
+  double sum = 0;
+  unsigned zeros = 0;
+  for (size_t i = 0; i < HLL_REGISTERS; i++) {
+    sum += 1.0 / (double)(1ULL << h->registers[i]);
+    zeros += h->registers[i] == 0;
+  }
+  double alpha = 0.7213 / (1 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+  // Con muchos registros vacíos la media armónica sesga para arriba: el
+  // conteo lineal sobre los vacíos es más preciso. Con hashes de 64 bits no
+  // hace falta la corrección de cardinalidades grandes
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * log(m / zeros);
+  }
+  return (uint64_t)(estimate + 0.5);
+}
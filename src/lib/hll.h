@@ -0,0 +1,37 @@
+#ifndef HLL_H_Qm3xT8vNc1RkW5yLp9ZsJd2Hf
+#define HLL_H_Qm3xT8vNc1RkW5yLp9ZsJd2Hf
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * hll.c - cantidad aproximada de elementos distintos de un flujo
+ *
+ * Implementa HyperLogLog (Flajolet et al.): cada elemento se hashea a 64
+ * bits; los primeros HLL_PRECISION bits eligen un registro, que guarda la
+ * racha de ceros más larga vista en el resto. La estimación sale de la media
+ * armónica de los registros, con conteo lineal para cardinalidades chicas.
+ *
+ * Ocupa HLL_REGISTERS bytes sin importar cuántos elementos se agreguen, con
+ * un error relativo típico de 1.04 / sqrt(HLL_REGISTERS) (~2.3%). Dos
+ * sketches se pueden unir tomando el máximo de cada registro.
+ */
+#define HLL_PRECISION 11
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+struct hll {
+  uint8_t registers[HLL_REGISTERS];
+};
+
+void hll_clear(struct hll *h);
+
+/** agrega los `len' bytes de `data' */
+void hll_add(struct hll *h, const void *data, size_t len);
+
+/** deja en `dst' la unión de los dos */
+void hll_merge(struct hll *dst, const struct hll *src);
+
+/** estimación de la cantidad de elementos distintos agregados */
+uint64_t hll_count(const struct hll *h);
+
+#endif
@@ -16,6 +16,7 @@
 #include <sys/signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #define N(x) (sizeof(x) / sizeof((x)[0]))
@@ -100,6 +101,8 @@ struct item {
   fd_interest interest;
   const fd_handler *handler;
   void *data;
+  /** se despacha antes que el resto en cada iteración */
+  bool priority;
 };
 
 /* tarea bloqueante */
@@ -116,6 +119,15 @@ struct blocking_job {
   struct blocking_job *next;
 };
 
+/* timer pendiente */
+struct timer {
+  /** vencimiento en nanosegundos de CLOCK_MONOTONIC */
+  uint64_t deadline;
+  unsigned long id;
+  selector_timer_handler handler;
+  void *data;
+};
+
 /** marca para usar en item->fd para saber que no está en uso */
 static const int FD_UNUSED = -1;
 
@@ -151,6 +163,16 @@ struct fdselector {
    * notificados.
    */
   struct blocking_job *resolution_jobs;
+
+  /** timers pendientes: min-heap por vencimiento */
+  struct timer *timers;
+  size_t timer_count, timer_capacity;
+  unsigned long next_timer_id;
+
+  /** cantidad de items con prioridad */
+  unsigned priority_count;
+
+  struct selector_stats stats;
 };
 
 /** cantidad máxima de file descriptors que la plataforma puede manejar */
@@ -310,6 +332,7 @@ void selector_destroy(fd_selector s) {
       s->fds = NULL;
       s->fd_size = 0;
     }
+    free(s->timers);
     free(s);
   }
 }
@@ -381,6 +404,9 @@ selector_status selector_unregister_fd(fd_selector s, const int fd) {
 
   item->interest = OP_NOOP;
   items_update_fdset_for_fd(s, item);
+  if (item->priority) {
+    s->priority_count--;
+  }
 
   memset(item, 0x00, sizeof(*item));
   item_init(item);
@@ -402,6 +428,10 @@ selector_status selector_set_interest(fd_selector s, int fd, fd_interest i) {
     ret = SELECTOR_IARGS;
     goto finally;
   }
+  s->stats.interest_calls++;
+  if (item->interest == i) {
+    s->stats.interest_noops++;
+  }
   item->interest = i;
   items_update_fdset_for_fd(s, item);
 finally:
@@ -421,39 +451,83 @@ selector_status selector_set_interest_key(struct selector_key *key,
   return ret;
 }
 
+selector_status selector_set_priority(fd_selector s, int fd, bool priority) {
+  selector_status ret = SELECTOR_SUCCESS;
+
+  if (NULL == s || INVALID_FD(fd)) {
+    ret = SELECTOR_IARGS;
+    goto finally;
+  }
+  struct item *item = s->fds + fd;
+  if (!ITEM_USED(item)) {
+    ret = SELECTOR_IARGS;
+    goto finally;
+  }
+  if (item->priority != priority) {
+    item->priority = priority;
+    if (priority) {
+      s->priority_count++;
+    } else {
+      s->priority_count--;
+    }
+  }
+finally:
+  return ret;
+}
+
+/** despacha los eventos que select() reportó para `item' */
+static void handle_item(fd_selector s, struct item *item) {
+  struct selector_key key = {
+      .s = s,
+      .fd = item->fd,
+      .data = item->data,
+  };
+  if (FD_ISSET(item->fd, &s->slave_r)) {
+    if (OP_READ & item->interest) {
+      if (0 == item->handler->handle_read) {
+        assert(("OP_READ arrived but no handler. bug!" == 0));
+      } else {
+        s->stats.dispatches++;
+        item->handler->handle_read(&key);
+      }
+    }
+  }
+  // el handler de lectura puede haber desregistrado el fd
+  if (ITEM_USED(item) && FD_ISSET(item->fd, &s->slave_w)) {
+    if (OP_WRITE & item->interest) {
+      if (0 == item->handler->handle_write) {
+        assert(("OP_WRITE arrived but no handler. bug!" == 0));
+      } else {
+        s->stats.dispatches++;
+        item->handler->handle_write(&key);
+      }
+    }
+  }
+}
+
 /**
  * se encarga de manejar los resultados del select.
  * se encuentra separado para facilitar el testing
  */
 static void handle_iteration(fd_selector s) {
   int n = s->max_fd;
-  struct selector_key key = {
-      .s = s,
-  };
 
+  // Primero los prioritarios. Los sacamos de los sets para no volver a
+  // despacharlos en la pasada general.
+  if (s->priority_count > 0) {
+    for (int i = 0; i <= n; i++) {
+      struct item *item = s->fds + i;
+      if (ITEM_USED(item) && item->priority) {
+        handle_item(s, item);
+        FD_CLR(i, &s->slave_r);
+        FD_CLR(i, &s->slave_w);
+      }
+    }
+  }
   for (int i = 0; i <= n; i++) {
     struct item *item = s->fds + i;
     if (ITEM_USED(item)) {
-      key.fd = item->fd;
-      key.data = item->data;
-      if (FD_ISSET(item->fd, &s->slave_r)) {
-        if (OP_READ & item->interest) {
-          if (0 == item->handler->handle_read) {
-            assert(("OP_READ arrived but no handler. bug!" == 0));
-          } else {
-            item->handler->handle_read(&key);
-          }
-        }
-      }
-      if (FD_ISSET(i, &s->slave_w)) {
-        if (OP_WRITE & item->interest) {
-          if (0 == item->handler->handle_write) {
-            assert(("OP_WRITE arrived but no handler. bug!" == 0));
-          } else {
-            item->handler->handle_write(&key);
-          }
-        }
-      }
+      handle_item(s, item);
     }
   }
 }
@@ -462,12 +536,17 @@ static void handle_block_notifications(fd_selector s) {
   struct selector_key key = {
       .s = s,
   };
+  // desenganchamos la lista antes de despachar: los handlers pueden volver a
+  // encolar trabajos (o esperar a hilos que lo hacen) sin deadlock.
   pthread_mutex_lock(&s->resolution_mutex);
   struct blocking_job *j = s->resolution_jobs;
+  s->resolution_jobs = 0;
+  pthread_mutex_unlock(&s->resolution_mutex);
+
   while (j != NULL) {
 
     struct item *item = s->fds + j->fd;
-    if (ITEM_USED(item)) {
+    if (ITEM_USED(item) && item->handler->handle_block != NULL) {
       key.fd = item->fd;
       key.data = item->data;
       item->handler->handle_block(&key);
@@ -477,8 +556,6 @@ static void handle_block_notifications(fd_selector s) {
     j = j->next;
     free(aux);
   }
-  s->resolution_jobs = 0;
-  pthread_mutex_unlock(&s->resolution_mutex);
 }
 
 selector_status selector_notify_block(fd_selector s, const int fd) {
@@ -506,17 +583,133 @@ finally:
   return ret;
 }
 
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void timer_swap(fd_selector s, size_t a, size_t b) {
+  struct timer aux = s->timers[a];
+  s->timers[a] = s->timers[b];
+  s->timers[b] = aux;
+}
+
+static void timers_sift_up(fd_selector s, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (s->timers[parent].deadline <= s->timers[i].deadline) {
+      break;
+    }
+    timer_swap(s, i, parent);
+    i = parent;
+  }
+}
+
+static void timers_sift_down(fd_selector s, size_t i) {
+  while (true) {
+    size_t min = i, l = 2 * i + 1, r = l + 1;
+    if (l < s->timer_count && s->timers[l].deadline < s->timers[min].deadline) {
+      min = l;
+    }
+    if (r < s->timer_count && s->timers[r].deadline < s->timers[min].deadline) {
+      min = r;
+    }
+    if (min == i) {
+      break;
+    }
+    timer_swap(s, i, min);
+    i = min;
+  }
+}
+
+static void timers_remove(fd_selector s, size_t i) {
+  s->timer_count--;
+  if (i != s->timer_count) {
+    s->timers[i] = s->timers[s->timer_count];
+    timers_sift_down(s, i);
+    timers_sift_up(s, i);
+  }
+}
+
+unsigned long selector_timer_add(fd_selector s, const unsigned ms,
+                                 selector_timer_handler handler, void *data) {
+  if (s == NULL || handler == NULL) {
+    return 0;
+  }
+  if (s->timer_count == s->timer_capacity) {
+    size_t capacity = s->timer_capacity == 0 ? 16 : s->timer_capacity * 2;
+    struct timer *tmp = realloc(s->timers, capacity * sizeof(*tmp));
+    if (tmp == NULL) {
+      return 0;
+    }
+    s->timers = tmp;
+    s->timer_capacity = capacity;
+  }
+  struct timer *t = s->timers + s->timer_count;
+  t->deadline = monotonic_ns() + (uint64_t)ms * 1000000ULL;
+  t->id = ++s->next_timer_id;
+  t->handler = handler;
+  t->data = data;
+  s->timer_count++;
+  // `t' deja de apuntar al timer después de reacomodar el heap
+  unsigned long id = t->id;
+  timers_sift_up(s, s->timer_count - 1);
+  return id;
+}
+
+void selector_timer_cancel(fd_selector s, const unsigned long id) {
+  if (s == NULL || id == 0) {
+    return;
+  }
+  // hay pocos timers vivos: alcanza con una búsqueda lineal
+  for (size_t i = 0; i < s->timer_count; i++) {
+    if (s->timers[i].id == id) {
+      timers_remove(s, i);
+      return;
+    }
+  }
+}
+
+/** acota el timeout de pselect al próximo vencimiento */
+static void timers_clamp_timeout(fd_selector s) {
+  if (s->timer_count == 0) {
+    return;
+  }
+  uint64_t now = monotonic_ns();
+  uint64_t wait =
+      s->timers[0].deadline > now ? s->timers[0].deadline - now : 0;
+  uint64_t max =
+      (uint64_t)s->slave_t.tv_sec * 1000000000ULL + s->slave_t.tv_nsec;
+  if (wait < max) {
+    s->slave_t.tv_sec = wait / 1000000000ULL;
+    s->slave_t.tv_nsec = wait % 1000000000ULL;
+  }
+}
+
+static void handle_timers(fd_selector s) {
+  uint64_t now = monotonic_ns();
+  // sacamos del heap antes de despachar: el handler puede reprogramarse
+  while (s->timer_count > 0 && s->timers[0].deadline <= now) {
+    struct timer t = s->timers[0];
+    timers_remove(s, 0);
+    t.handler(s, t.data);
+  }
+}
+
 selector_status selector_select(fd_selector s) {
   selector_status ret = SELECTOR_SUCCESS;
 
   memcpy(&s->slave_r, &s->master_r, sizeof(s->slave_r));
   memcpy(&s->slave_w, &s->master_w, sizeof(s->slave_w));
   memcpy(&s->slave_t, &s->master_t, sizeof(s->slave_t));
+  timers_clamp_timeout(s);
 
   s->selector_thread = pthread_self();
 
   int fds = pselect(s->max_fd + 1, &s->slave_r, &s->slave_w, 0, &s->slave_t,
                     &emptyset);
+  s->stats.wakeups++;
   if (-1 == fds) {
     switch (errno) {
     case EAGAIN:
@@ -544,14 +737,19 @@ selector_status selector_select(fd_selector s) {
   }
   if (ret == SELECTOR_SUCCESS) {
     handle_block_notifications(s);
+    handle_timers(s);
   }
 finally:
   return ret;
 }
 
+void selector_get_stats(fd_selector s, struct selector_stats *out) {
+  *out = s->stats;
+}
+
 int selector_fd_set_nio(const int fd) {
   int ret = 0;
-  int flags = fcntl(fd, F_GETFD, 0);
+  int flags = fcntl(fd, F_GETFL, 0);
   if (flags == -1) {
     ret = -1;
   } else {
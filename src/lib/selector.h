@@ -4,6 +4,7 @@
 #include <sys/time.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 
 /**
@@ -171,6 +172,13 @@ selector_set_interest(fd_selector s, int fd, fd_interest i);
 selector_status
 selector_set_interest_key(struct selector_key *key, fd_interest i);
 
+/**
+ * marca un file descriptor como prioritario: en cada iteración sus eventos
+ * se despachan antes que los del resto.
+ */
+selector_status
+selector_set_priority(fd_selector s, int fd, bool priority);
+
 
 /**
  * se bloquea hasta que hay eventos disponible y los despacha.
@@ -192,4 +200,42 @@ selector_status
 selector_notify_block(fd_selector s,
                  const int   fd);
 
+/**
+ * Timers: `handler' corre una única vez en el hilo del selector, en la
+ * primera iteración posterior al vencimiento (después de despachar la E/S).
+ * Para un timer periódico el handler vuelve a programarse.
+ */
+typedef void (*selector_timer_handler)(fd_selector s, void *data);
+
+/**
+ * programa `handler' para dentro de `ms' milisegundos.
+ * Retorna un identificador (> 0) para cancelarlo, o 0 si no hay memoria.
+ */
+unsigned long
+selector_timer_add(fd_selector s, const unsigned ms,
+                   selector_timer_handler handler, void *data);
+
+/** cancela un timer pendiente. Tolera ids que ya vencieron */
+void
+selector_timer_cancel(fd_selector s, const unsigned long id);
+
+/**
+ * Actividad acumulada del selector: cuántas veces se despertó y cuánto
+ * trabajo hizo en cada despertar. Sirve para ver cuántas vueltas del loop
+ * cuesta mover cada byte.
+ */
+struct selector_stats {
+    /** retornos de pselect(), con eventos o no */
+    uint64_t wakeups;
+    /** handlers de lectura y escritura invocados */
+    uint64_t dispatches;
+    /** llamadas a selector_set_interest... */
+    uint64_t interest_calls;
+    /** ...y las que dejaron el interés como estaba */
+    uint64_t interest_noops;
+};
+
+void
+selector_get_stats(fd_selector s, struct selector_stats *out);
+
 #endif
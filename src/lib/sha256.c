@@ -0,0 +1,210 @@
+/**
+ * sha256.c - SHA-256, HMAC-SHA256 y PBKDF2-HMAC-SHA256
+ */
+#include <string.h>
+
+#include "sha256.h"
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void compress(uint32_t state[8], const uint8_t block[64]) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t S1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + S1 + ch + K[i] + w[i];
+    uint32_t S0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = S0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void sha256_init(struct sha256_ctx *ctx) {
+  static const uint32_t H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+  memcpy(ctx->state, H0, sizeof(H0));
+  ctx->length = 0;
+  ctx->used = 0;
+}
+
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len) {
+  const uint8_t *p = data;
+  ctx->length += len;
+
+  if (ctx->used > 0) {
+    size_t n = SHA256_BLOCK_LEN - ctx->used;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(ctx->block + ctx->used, p, n);
+    ctx->used += n;
+    p += n;
+    len -= n;
+    if (ctx->used < SHA256_BLOCK_LEN) {
+      return;
+    }
+    compress(ctx->state, ctx->block);
+    ctx->used = 0;
+  }
+  while (len >= SHA256_BLOCK_LEN) {
+    compress(ctx->state, p);
+    p += SHA256_BLOCK_LEN;
+    len -= SHA256_BLOCK_LEN;
+  }
+  if (len > 0) {
+    memcpy(ctx->block, p, len);
+    ctx->used = len;
+  }
+}
+
+void sha256_final(struct sha256_ctx *ctx, uint8_t out[SHA256_DIGEST_LEN]) {
+  uint64_t bits = ctx->length * 8;
+
+  ctx->block[ctx->used++] = 0x80;
+  if (ctx->used > SHA256_BLOCK_LEN - 8) {
+    memset(ctx->block + ctx->used, 0, SHA256_BLOCK_LEN - ctx->used);
+    compress(ctx->state, ctx->block);
+    ctx->used = 0;
+  }
+  memset(ctx->block + ctx->used, 0, SHA256_BLOCK_LEN - 8 - ctx->used);
+  for (int i = 0; i < 8; i++) {
+    ctx->block[SHA256_BLOCK_LEN - 1 - i] = (uint8_t)(bits >> (i * 8));
+  }
+  compress(ctx->state, ctx->block);
+
+  for (int i = 0; i < 8; i++) {
+    out[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+    out[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+    out[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+    out[i * 4 + 3] = (uint8_t)ctx->state[i];
+  }
+}
+
+void sha256(const void *data, size_t len, uint8_t out[SHA256_DIGEST_LEN]) {
+  struct sha256_ctx ctx;
+  sha256_init(&ctx);
+  sha256_update(&ctx, data, len);
+  sha256_final(&ctx, out);
+}
+
+/** contextos inner/outer ya cargados con la clave, reutilizables */
+struct hmac_ctx {
+  struct sha256_ctx inner, outer;
+};
+
+static void hmac_init(struct hmac_ctx *h, const uint8_t *key, size_t key_len) {
+  uint8_t k[SHA256_BLOCK_LEN] = {0};
+  if (key_len > SHA256_BLOCK_LEN) {
+    sha256(key, key_len, k);
+  } else {
+    memcpy(k, key, key_len);
+  }
+
+  uint8_t pad[SHA256_BLOCK_LEN];
+  for (int i = 0; i < SHA256_BLOCK_LEN; i++) {
+    pad[i] = k[i] ^ 0x36;
+  }
+  sha256_init(&h->inner);
+  sha256_update(&h->inner, pad, sizeof(pad));
+  for (int i = 0; i < SHA256_BLOCK_LEN; i++) {
+    pad[i] = k[i] ^ 0x5c;
+  }
+  sha256_init(&h->outer);
+  sha256_update(&h->outer, pad, sizeof(pad));
+}
+
+static void hmac_run(const struct hmac_ctx *h, const void *data, size_t len,
+                     uint8_t out[SHA256_DIGEST_LEN]) {
+  struct sha256_ctx ctx = h->inner;
+  uint8_t digest[SHA256_DIGEST_LEN];
+  sha256_update(&ctx, data, len);
+  sha256_final(&ctx, digest);
+
+  ctx = h->outer;
+  sha256_update(&ctx, digest, sizeof(digest));
+  sha256_final(&ctx, out);
+}
+
+void hmac_sha256(const uint8_t *key, size_t key_len, const void *data,
+                 size_t len, uint8_t out[SHA256_DIGEST_LEN]) {
+  struct hmac_ctx h;
+  hmac_init(&h, key, key_len);
+  hmac_run(&h, data, len, out);
+}
+
+void pbkdf2_sha256(const uint8_t *password, size_t password_len,
+                   const uint8_t *salt, size_t salt_len, uint32_t iterations,
+                   uint8_t *out, size_t out_len) {
+  struct hmac_ctx h;
+  hmac_init(&h, password, password_len);
+
+  for (uint32_t block = 1; out_len > 0; block++) {
+    // U1 = PRF(P, S || INT(i))
+    struct sha256_ctx ctx = h.inner;
+    uint8_t be[4] = {(uint8_t)(block >> 24), (uint8_t)(block >> 16),
+                     (uint8_t)(block >> 8), (uint8_t)block};
+    uint8_t u[SHA256_DIGEST_LEN], t[SHA256_DIGEST_LEN];
+    sha256_update(&ctx, salt, salt_len);
+    sha256_update(&ctx, be, sizeof(be));
+    sha256_final(&ctx, u);
+    ctx = h.outer;
+    sha256_update(&ctx, u, sizeof(u));
+    sha256_final(&ctx, u);
+    memcpy(t, u, sizeof(t));
+
+    for (uint32_t i = 1; i < iterations; i++) {
+      hmac_run(&h, u, sizeof(u), u);
+      for (int j = 0; j < SHA256_DIGEST_LEN; j++) {
+        t[j] ^= u[j];
+      }
+    }
+
+    size_t n = out_len < sizeof(t) ? out_len : sizeof(t);
+    memcpy(out, t, n);
+    out += n;
+    out_len -= n;
+  }
+}
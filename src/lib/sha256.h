@@ -0,0 +1,43 @@
+#ifndef SHA256_H_p4Vd9KqT2nXwR7cJmL0bHsYe
+#define SHA256_H_p4Vd9KqT2nXwR7cJmL0bHsYe
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * sha256.c - SHA-256 (FIPS 180-4), HMAC-SHA256 (RFC 2104) y
+ *            PBKDF2-HMAC-SHA256 (RFC 8018)
+ *
+ * Todas las funciones son reentrantes y pueden usarse desde cualquier hilo.
+ */
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_BLOCK_LEN 64
+
+struct sha256_ctx {
+  uint32_t state[8];
+  uint64_t length; // bytes procesados
+  uint8_t block[SHA256_BLOCK_LEN];
+  size_t used; // bytes pendientes en `block'
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+void sha256_final(struct sha256_ctx *ctx, uint8_t out[SHA256_DIGEST_LEN]);
+
+/** digest de `len' bytes de `data' en una sola llamada */
+void sha256(const void *data, size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+
+void hmac_sha256(const uint8_t *key, size_t key_len, const void *data,
+                 size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+
+/**
+ * Deriva `out_len' bytes de `password' y `salt' con `iterations' rondas de
+ * PBKDF2-HMAC-SHA256. Es deliberadamente costosa: no llamar desde el hilo del
+ * selector con muchas iteraciones.
+ */
+void pbkdf2_sha256(const uint8_t *password, size_t password_len,
+                   const uint8_t *salt, size_t salt_len, uint32_t iterations,
+                   uint8_t *out, size_t out_len);
+
+#endif
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "topk.h"
+
+struct entry {
+  char key[TOPK_KEY_MAX];
+  unsigned hash;
+  uint64_t weight;
+  uint64_t error;
+  /** posición en el heap */
+  size_t slot;
+  /** siguiente en la cadena del bucket; -1 termina */
+  long next;
+};
+
+struct topk {
+  size_t capacity, used;
+  struct entry *entries;
+  /** heap de mínimos por peso: índices en `entries' */
+  size_t *heap;
+  /** cabezas de las cadenas, potencia de dos de al menos 2 * capacity */
+  long *buckets;
+  size_t nbuckets;
+};
+
+static unsigned key_hash(const char *key) {
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (; *key != '\0'; key++) {
+    h = (h ^ (unsigned char)*key) * 16777619u;
+  }
+  return h;
+}
+
+topk topk_new(size_t capacity) {
+  if (capacity == 0) {
+    return NULL;
+  }
+  struct topk *t = calloc(1, sizeof(*t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->capacity = capacity;
+  t->nbuckets = 1;
+  while (t->nbuckets < 2 * capacity) {
+    t->nbuckets <<= 1;
+  }
+  t->entries = calloc(capacity, sizeof(*t->entries));
+  t->heap = calloc(capacity, sizeof(*t->heap));
+  t->buckets = malloc(t->nbuckets * sizeof(*t->buckets));
+  if (t->entries == NULL || t->heap == NULL || t->buckets == NULL) {
+    topk_destroy(t);
+    return NULL;
+  }
+  for (size_t i = 0; i < t->nbuckets; i++) {
+    t->buckets[i] = -1;
+  }
+  return t;
+}
+
+void topk_destroy(topk t) {
+  if (t != NULL) {
+    free(t->entries);
+    free(t->heap);
+    free(t->buckets);
+    free(t);
+  }
+}
+
+static void heap_swap(topk t, size_t a, size_t b) {
+  size_t tmp = t->heap[a];
+  t->heap[a] = t->heap[b];
+  t->heap[b] = tmp;
+  t->entries[t->heap[a]].slot = a;
+  t->entries[t->heap[b]].slot = b;
+}
+
+static uint64_t heap_weight(topk t, size_t slot) {
+  return t->entries[t->heap[slot]].weight;
+}
+
+static void sift_up(topk t, size_t slot) {
+  while (slot > 0) {
+    size_t parent = (slot - 1) / 2;
+    if (heap_weight(t, parent) <= heap_weight(t, slot)) {
+      return;
+    }
+    heap_swap(t, slot, parent);
+    slot = parent;
+  }
+}
+
+// Los pesos sólo crecen: una entrada ya ubicada únicamente puede bajar
+static void sift_down(topk t, size_t slot) {
+  for (;;) {
+    size_t least = slot, left = 2 * slot + 1, right = left + 1;
+    if (left < t->used && heap_weight(t, left) < heap_weight(t, least)) {
+      least = left;
+    }
+    if (right < t->used && heap_weight(t, right) < heap_weight(t, least)) {
+      least = right;
+    }
+    if (least == slot) {
+      return;
+    }
+    heap_swap(t, slot, least);
+    slot = least;
+  }
+}
+
+static void chain_unlink(topk t, long index) {
+  long *link = &t->buckets[t->entries[index].hash & (t->nbuckets - 1)];
+  while (*link != index) {
+    link = &t->entries[*link].next;
+  }
+  *link = t->entries[index].next;
+}
+
+static void chain_link(topk t, long index) {
+  long *head = &t->buckets[t->entries[index].hash & (t->nbuckets - 1)];
+  t->entries[index].next = *head;
+  *head = index;
+}
+
+void topk_add(topk t, const char *key, uint64_t weight) {
+  if (t == NULL || key == NULL) {
+    return;
+  }
+  unsigned hash = key_hash(key);
+  for (long i = t->buckets[hash & (t->nbuckets - 1)]; i >= 0;
+       i = t->entries[i].next) {
+    struct entry *e = &t->entries[i];
+    if (e->hash == hash && strncmp(e->key, key, TOPK_KEY_MAX - 1) == 0) {
+      e->weight += weight;
+      sift_down(t, e->slot);
+      return;
+    }
+  }
+
+  long index;
+  uint64_t floor = 0;
+  if (t->used < t->capacity) {
+    // todavía hay lugar: la entrada nueva entra por el final del heap
+    index = t->used;
+    t->entries[index].slot = t->used;
+    t->heap[t->used++] = index;
+  } else {
+    // reemplazamos a la más liviana, que hereda su peso como error
+    index = t->heap[0];
+    floor = t->entries[index].weight;
+    chain_unlink(t, index);
+  }
+
+  struct entry *e = &t->entries[index];
+  strncpy(e->key, key, TOPK_KEY_MAX - 1);
+  e->key[TOPK_KEY_MAX - 1] = '\0';
+  e->hash = hash;
+  e->weight = floor + weight;
+  e->error = floor;
+  chain_link(t, index);
+  sift_up(t, e->slot);
+  sift_down(t, e->slot);
+}
+
+static int by_weight_desc(const void *a, const void *b) {
+  const struct topk_item *x = a, *y = b;
+  return x->weight < y->weight ? 1 : x->weight > y->weight ? -1 : 0;
+}
+
+size_t topk_list(topk t, struct topk_item *out, size_t n) {
+  if (t == NULL) {
+    return 0;
+  }
+  struct topk_item *all = malloc(t->used * sizeof(*all) + 1);
+  if (all == NULL) {
+    return 0;
+  }
+  for (size_t i = 0; i < t->used; i++) {
+    all[i] = (struct topk_item){.key = t->entries[i].key,
+                                .weight = t->entries[i].weight,
+                                .error = t->entries[i].error};
+  }
+  qsort(all, t->used, sizeof(*all), by_weight_desc);
+  if (n > t->used) {
+    n = t->used;
+  }
+  memcpy(out, all, n * sizeof(*out));
+  free(all);
+  return n;
+}
@@ -0,0 +1,45 @@
+#ifndef TOPK_H_Vn8cR2sLq5JwX0tHbE7mKa4Dz
+#define TOPK_H_Vn8cR2sLq5JwX0tHbE7mKa4Dz
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * topk.c - los elementos más pesados de un flujo, en memoria acotada
+ *
+ * Implementa Space-Saving (Metwally et al.): se siguen a lo sumo `capacity'
+ * claves. Una clave nueva con la tabla llena reemplaza a la de menor peso y
+ * hereda ese peso como cota de error. Toda clave con más de 1/capacity del
+ * peso total está garantizada en la tabla, y el peso informado de cada una
+ * sobreestima el real en a lo sumo su `error'.
+ *
+ * Las claves se copian (hasta TOPK_KEY_MAX - 1 bytes). Agregar cuesta
+ * O(log capacity): un heap de mínimos ordena las claves por peso y una tabla
+ * de hash las indexa.
+ */
+#define TOPK_KEY_MAX 272
+
+struct topk_item {
+  const char *key;
+  uint64_t weight;
+  /** cuánto puede sobrar de `weight' */
+  uint64_t error;
+};
+
+typedef struct topk *topk;
+
+/** Retorna NULL si no hay memoria */
+topk topk_new(size_t capacity);
+
+void topk_destroy(topk t);
+
+/** suma `weight' a `key' */
+void topk_add(topk t, const char *key, uint64_t weight);
+
+/**
+ * Copia en `out' hasta `n' claves, de mayor a menor peso, y retorna cuántas
+ * copió. Las claves apuntan dentro de `t': valen hasta el próximo topk_add.
+ */
+size_t topk_list(topk t, struct topk_item *out, size_t n);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * workers.c - pool de hilos para trabajos bloqueantes
+ */
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "workers.h"
+
+struct worker_pool {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  /** cola FIFO de trabajos pendientes */
+  struct worker_job *head, *tail;
+  bool stop;
+
+  unsigned nthreads;
+  pthread_t *threads;
+};
+
+static void *worker_loop(void *arg) {
+  struct worker_pool *p = arg;
+
+  pthread_mutex_lock(&p->mutex);
+  while (true) {
+    while (p->head == NULL && !p->stop) {
+      pthread_cond_wait(&p->cond, &p->mutex);
+    }
+    if (p->stop) {
+      break;
+    }
+    struct worker_job *job = p->head;
+    p->head = job->next;
+    if (p->head == NULL) {
+      p->tail = NULL;
+    }
+    job->next = NULL;
+
+    pthread_mutex_unlock(&p->mutex);
+    job->run(job);
+    pthread_mutex_lock(&p->mutex);
+  }
+  pthread_mutex_unlock(&p->mutex);
+
+  return NULL;
+}
+
+worker_pool workers_new(const unsigned threads) {
+  if (threads == 0) {
+    return NULL;
+  }
+  struct worker_pool *p = calloc(1, sizeof(*p));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->threads = calloc(threads, sizeof(*p->threads));
+  if (p->threads == NULL) {
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->cond, NULL);
+
+  for (unsigned i = 0; i < threads; i++) {
+    if (pthread_create(&p->threads[i], NULL, worker_loop, p) != 0) {
+      break;
+    }
+    p->nthreads++;
+  }
+  if (p->nthreads == 0) {
+    workers_destroy(p);
+    return NULL;
+  }
+
+  return p;
+}
+
+bool workers_submit(worker_pool p, struct worker_job *job) {
+  if (p == NULL || job == NULL || job->run == NULL) {
+    return false;
+  }
+  bool ret = true;
+
+  job->next = NULL;
+  pthread_mutex_lock(&p->mutex);
+  if (p->stop) {
+    ret = false;
+  } else {
+    if (p->tail == NULL) {
+      p->head = job;
+    } else {
+      p->tail->next = job;
+    }
+    p->tail = job;
+    pthread_cond_signal(&p->cond);
+  }
+  pthread_mutex_unlock(&p->mutex);
+
+  return ret;
+}
+
+void workers_destroy(worker_pool p) {
+  if (p == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&p->mutex);
+  p->stop = true;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+
+  for (unsigned i = 0; i < p->nthreads; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mutex);
+  free(p->threads);
+  free(p);
+}
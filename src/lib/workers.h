@@ -0,0 +1,40 @@
+#ifndef WORKERS_H_Qm3xT7bZ1kLpV9sRdN2eHcWy
+#define WORKERS_H_Qm3xT7bZ1kLpV9sRdN2eHcWy
+
+#include <stdbool.h>
+
+/**
+ * workers.c - pool de hilos para trabajos bloqueantes
+ *
+ * Complementa a `selector_notify_block': el handler encola un trabajo en el
+ * pool, un hilo lo ejecuta y al terminar el propio trabajo notifica al
+ * selector. La cantidad de hilos es fija, por lo que la concurrencia de los
+ * trabajos bloqueantes queda acotada y los pendientes esperan en una cola.
+ *
+ * El pool no es dueño de los trabajos: `run' es responsable de liberar (o
+ * soltar su referencia sobre) el trabajo. Un trabajo que ya no le interesa a
+ * nadie debería detectarlo al comenzar `run' y retornar sin hacer nada.
+ */
+struct worker_job {
+  /** ejecutado en alguno de los hilos del pool */
+  void (*run)(struct worker_job *job);
+
+  /** uso interno de la cola */
+  struct worker_job *next;
+};
+
+typedef struct worker_pool *worker_pool;
+
+/** crea un pool con `threads' hilos. Retorna NULL ante error */
+worker_pool workers_new(const unsigned threads);
+
+/** encola un trabajo. Retorna false si el pool no lo puede aceptar */
+bool workers_submit(worker_pool p, struct worker_job *job);
+
+/**
+ * detiene los hilos y destruye el pool. Los trabajos que quedaron en la cola
+ * no se ejecutan. Tolera NULL.
+ */
+void workers_destroy(worker_pool p);
+
+#endif
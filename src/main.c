@@ -12,9 +12,26 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "admission.h"
 #include "args.h"
+#include "management/history.h"
 #include "management/mng_prot.h"
+#include "management/statspage.h"
 #include "server.h"
+#include "socks5/auth_verify.h"
+#include "socks5/dns.h"
+#include "socks5/scheduler.h"
+#include "socks5/sessions.h"
+#include "socks5/sockopts.h"
+#include "socks5/trusted.h"
+#include "socks5/uniques.h"
+
+/** conexiones con Fast Open pendientes de accept en el listener SOCKS */
+#define TFO_QUEUE_LEN 256
+/** segundos que el kernel retiene una conexión SOCKS hasta que llegue HELLO */
+#define DEFER_ACCEPT_SECS 10
+/** cola de conexiones pendientes del listener de management */
+#define MNG_BACKLOG 20
 
 static bool terminate = false;
 
@@ -26,7 +43,12 @@ static void sig_handler(const int signal) {
 
 // Crea y configura un socket pasivo TCP utilizando getaddrinfo. Soporta IPv4 e
 // IPv6.
-static int create_tcp_server_socket(const char *addr, const char *port) {
+// `fastopen' es el largo de la cola de TCP Fast Open (0 = sin Fast Open) y
+// `defer_accept' los segundos que el kernel retiene una conexión sin datos
+// antes de entregarla (0 = la entrega al completar el handshake).
+static int create_tcp_server_socket(const char *addr, const char *port,
+                                    int backlog, int fastopen,
+                                    int defer_accept) {
   struct addrinfo hints;
   struct addrinfo *result, *rp;
   int sfd = -1;
@@ -65,6 +87,21 @@ static int create_tcp_server_socket(const char *addr, const char *port) {
       setsockopt(sfd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
     }
 
+    // 3. Fast Open: los clientes con cookie nos mandan el saludo en el SYN.
+    // También depende de net.ipv4.tcp_fastopen, así que no es crítico
+    if (fastopen > 0 && setsockopt(sfd, IPPROTO_TCP, TCP_FASTOPEN, &fastopen,
+                                   sizeof(fastopen)) < 0) {
+      perror("setsockopt(TCP_FASTOPEN)");
+    }
+
+    // 4. Defer accept: nos despertamos cuando ya llegó el saludo, no por el
+    // handshake. Tampoco es crítico
+    if (defer_accept > 0 &&
+        setsockopt(sfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept,
+                   sizeof(defer_accept)) < 0) {
+      perror("setsockopt(TCP_DEFER_ACCEPT)");
+    }
+
     if (bind(sfd, rp->ai_addr, rp->ai_addrlen) == 0)
       break; // Éxito
 
@@ -79,8 +116,7 @@ static int create_tcp_server_socket(const char *addr, const char *port) {
 
   freeaddrinfo(result);
 
-  if (listen(sfd, 20) <
-      0) { // CAMBIAR EL MAGIC VALUE (20), posiblemente por SOMAXCONN
+  if (listen(sfd, backlog) < 0) {
     perror("listen");
     close(sfd);
     return -1;
@@ -102,22 +138,51 @@ int main(const int argc, char **argv) {
   struct socks5args args;
   parse_args(argc, argv, &args);
 
-  // Inicializar usuarios de gestión
+  // Inicializar usuarios de gestión. El hilo principal es el único reactor
+  int users_reader = users_reader_register();
   init_users();
   for (int i = 0; i < MAX_USERS; i++) {
     if (args.users[i].name != NULL) {
       add_user(args.users[i].name, args.users[i].pass);
     }
   }
+  sched_set_capacity(args.capacity);
+  for (int i = 0; i < MAX_TRUSTED && args.trusted[i] != NULL; i++) {
+    if (!trusted_add(args.trusted[i])) {
+      fprintf(stderr, "Invalid trusted network: %s\n", args.trusted[i]);
+      return 1;
+    }
+  }
+  for (int i = 0; i < MAX_SOCKOPTS && args.sockopts[i] != NULL; i++) {
+    if (sockopts_set(args.sockopts[i]) != SOCKOPT_SUCCESS) {
+      fprintf(stderr, "Invalid socket option: %s\n", args.sockopts[i]);
+      return 1;
+    }
+  }
+  if (args.userdb_path != NULL && !load_user_db(args.userdb_path)) {
+    fprintf(stderr, "Failed to load user database %s\n", args.userdb_path);
+    return 1;
+  }
 
   setbuf(stdout, NULL);
 
+  if (!dns_init()) {
+    fprintf(stderr, "Failed to start resolver threads\n");
+    return 1;
+  }
+  if (!auth_verify_init()) {
+    fprintf(stderr, "Failed to start password verifier threads\n");
+    return 1;
+  }
+
   // Convertir puerto a string para getaddrinfo
   char port_str[8];
   snprintf(port_str, sizeof(port_str), "%d", args.socks_port);
 
   // 2. Crear el socket del servidor usando create_tcp_server_socket
-  int server_socket = create_tcp_server_socket(args.socks_addr, port_str);
+  int server_socket = create_tcp_server_socket(
+      args.socks_addr, port_str, args.backlog, TFO_QUEUE_LEN,
+      DEFER_ACCEPT_SECS);
   if (server_socket < 0) {
     fprintf(stderr, "Failed to start server on %s:%s\n", args.socks_addr,
             port_str);
@@ -155,6 +220,7 @@ int main(const int argc, char **argv) {
     close(server_socket);
     return 1;
   }
+  metrics_watch_loop(selector);
 
   // Pasamos &args como data para que el handler pueda acceder a los usuarios
   // configurados
@@ -172,7 +238,8 @@ int main(const int argc, char **argv) {
   char mng_port_str[8];
   snprintf(mng_port_str, sizeof(mng_port_str), "%d", args.mng_port);
 
-  int mng_socket = create_tcp_server_socket(args.mng_addr, mng_port_str);
+  int mng_socket = create_tcp_server_socket(args.mng_addr, mng_port_str,
+                                            MNG_BACKLOG, 0, 0);
   if (mng_socket < 0) {
     fprintf(stderr, "Failed to start management server on %s:%s\n",
             args.mng_addr, mng_port_str);
@@ -210,6 +277,38 @@ int main(const int argc, char **argv) {
     return 1;
   }
 
+  if (!admission_init(selector, server_socket)) {
+    // sin reserva no podemos rechazar limpiamente al quedarnos sin fds
+    perror("Failed to initialize admission control");
+  }
+
+  sessions_init();
+
+  if (!history_init(selector)) {
+    perror("Failed to start metrics history");
+  }
+
+  if (!uniques_init(selector)) {
+    perror("Failed to schedule unique counts rollover");
+  }
+
+  // -S se usa tal cual: recortarlo crearía y borraría otro archivo
+  char default_statspage[PATH_MAX];
+  snprintf(default_statspage, sizeof(default_statspage),
+           "/dev/shm/socks5d-%u.stats", args.socks_port);
+  const char *statspage_path = args.statspage_path != NULL
+                                   ? args.statspage_path
+                                   : default_statspage;
+  if (!statspage_open(selector, statspage_path)) {
+    // las métricas siguen disponibles por management
+    perror("Failed to publish stats page");
+  }
+
+  if (!watch_user_db(selector)) {
+    // sin vigilancia la base sigue cargada, sólo se pierde la recarga
+    perror("Failed to watch user database");
+  }
+
   // 5. Loop principal
   // Configuro señales para poder terminar el programa con Ctrl+C
   signal(SIGTERM, sig_handler);
@@ -223,7 +322,9 @@ int main(const int argc, char **argv) {
       fprintf(stderr, "Error in selector_select: %s\n", selector_error(ss));
       break;
     }
+    users_quiescent(users_reader);
   }
+  statspage_close();
   // Cierra los sockets
   if (selector != NULL)
     selector_destroy(selector);
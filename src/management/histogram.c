@@ -0,0 +1,76 @@
+#include "histogram.h"
+
+unsigned histogram_bucket(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  unsigned msb = 63 - __builtin_clzll(value);
+  if (msb >= HISTOGRAM_MAX_BITS) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  // los HISTOGRAM_SUB_BITS bits que siguen al más alto eligen el sub-bucket
+  unsigned shift = msb - HISTOGRAM_SUB_BITS;
+  unsigned sub = (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+  return HISTOGRAM_SUB_BUCKETS * (shift + 1) + sub;
+}
+
+// Punto medio del bucket: el valor representativo con menor error
+static uint64_t bucket_value(unsigned bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+  uint64_t low = sub << shift;
+  return low + ((1ULL << shift) >> 1);
+}
+
+void histogram_record(struct histogram *h, uint64_t value) {
+  atomic_fetch_add_explicit(&h->counts[histogram_bucket(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+}
+
+uint64_t histogram_count(const struct histogram *h) {
+  uint64_t total = 0;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    total += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t histogram_snapshot(const struct histogram *h,
+                            uint64_t counts[HISTOGRAM_BUCKETS]) {
+  uint64_t total = 0;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    counts[i] = atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    total += counts[i];
+  }
+  return total;
+}
+
+uint64_t histogram_snapshot_percentile(const uint64_t counts[HISTOGRAM_BUCKETS],
+                                       uint64_t total, double q) {
+  if (total == 0) {
+    return 0;
+  }
+  // rango del valor buscado, contando desde 1
+  uint64_t rank = (uint64_t)(q * total + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return bucket_value(i);
+    }
+  }
+  return bucket_value(HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t histogram_percentile(const struct histogram *h, double q) {
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total = histogram_snapshot(h, counts);
+  return histogram_snapshot_percentile(counts, total, q);
+}
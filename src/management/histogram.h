@@ -0,0 +1,56 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * histogram.c - histogramas log-lineales (al estilo HDR)
+ *
+ * Los valores menores a HISTOGRAM_SUB_BUCKETS van cada uno a su propio
+ * bucket; a partir de ahí cada potencia de dos se parte en
+ * HISTOGRAM_SUB_BUCKETS buckets iguales, así que el error relativo de un
+ * percentil no pasa de 1/HISTOGRAM_SUB_BUCKETS (~3%) sin importar la
+ * magnitud. Los valores desde 2^HISTOGRAM_MAX_BITS van al último bucket.
+ *
+ * Registrar es un incremento atómico relajado: se puede hacer desde
+ * cualquier hilo y leer mientras tanto.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_BUCKETS                                                      \
+  (HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1))
+
+struct histogram {
+  _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+  /** suma de los valores registrados */
+  _Atomic uint64_t sum;
+};
+
+/** bucket en el que cae `value'; los anteriores sólo tienen valores menores */
+unsigned histogram_bucket(uint64_t value);
+
+/**
+ * Copia los contadores de `h' a `counts' y retorna su total: los percentiles
+ * y acumulados que se calculen sobre la copia son consistentes entre sí.
+ */
+uint64_t histogram_snapshot(const struct histogram *h,
+                            uint64_t counts[HISTOGRAM_BUCKETS]);
+
+void histogram_record(struct histogram *h, uint64_t value);
+
+/** cantidad de valores registrados */
+uint64_t histogram_count(const struct histogram *h);
+
+/**
+ * Valor por debajo del cual queda la fracción `q' (entre 0 y 1) de los
+ * registrados, con la precisión de un bucket. 0 si está vacío.
+ */
+uint64_t histogram_percentile(const struct histogram *h, double q);
+
+/** igual, sobre una copia tomada con histogram_snapshot */
+uint64_t histogram_snapshot_percentile(const uint64_t counts[HISTOGRAM_BUCKETS],
+                                       uint64_t total, double q);
+
+#endif
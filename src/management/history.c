@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "history.h"
+#include "metrics.h"
+
+#define TICK_MS 1000
+
+struct sample {
+  /** fin del intervalo (hora del sistema) */
+  time_t at;
+  uint64_t bytes, sessions, errors;
+  /** máximo de sesiones activas y de bytes en un segundo del intervalo */
+  uint64_t active, peak_bytes;
+};
+
+struct ring {
+  struct sample *samples;
+  size_t capacity;
+  /** muestras agregadas desde el arranque: la próxima va en count % capacity */
+  uint64_t count;
+  unsigned resolution;
+};
+
+static struct sample second_samples[HISTORY_SECONDS];
+static struct sample minute_samples[HISTORY_MINUTES];
+
+static struct ring seconds = {second_samples, HISTORY_SECONDS, 0, 1};
+static struct ring minutes = {minute_samples, HISTORY_MINUTES, 0, 60};
+
+/** minuto en curso, armado con las muestras de sus segundos */
+static struct sample minute;
+static unsigned minute_seconds = 0;
+
+/** valores de los contadores en la muestra anterior */
+static uint64_t last_bytes, last_sessions, last_errors;
+/** segundo (de CLOCK_MONOTONIC) de la última muestra */
+static uint64_t last_tick;
+
+static uint64_t monotonic_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static void ring_push(struct ring *r, const struct sample *s) {
+  r->samples[r->count % r->capacity] = *s;
+  r->count++;
+}
+
+static void push_second(const struct sample *s) {
+  ring_push(&seconds, s);
+
+  minute.at = s->at;
+  minute.bytes += s->bytes;
+  minute.sessions += s->sessions;
+  minute.errors += s->errors;
+  if (s->active > minute.active) {
+    minute.active = s->active;
+  }
+  if (s->bytes > minute.peak_bytes) {
+    minute.peak_bytes = s->bytes;
+  }
+  if (++minute_seconds == 60) {
+    ring_push(&minutes, &minute);
+    minute = (struct sample){0};
+    minute_seconds = 0;
+  }
+}
+
+static void sample_tick(fd_selector s, void *data) {
+  (void)data;
+  uint64_t bytes = get_transferred_bytes();
+  uint64_t sessions = get_historic_connections();
+  uint64_t errors = get_session_errors();
+  uint64_t active = get_current_connections();
+  time_t now = time(NULL);
+
+  // Si el loop se demoró y pasaron varios segundos, los que faltan quedan
+  // vacíos y lo acumulado va al último: los totales siguen cerrando
+  uint64_t tick = monotonic_s();
+  for (uint64_t missed = last_tick + 1; missed < tick; missed++) {
+    struct sample empty = {.at = now - (time_t)(tick - missed),
+                           .active = active};
+    push_second(&empty);
+  }
+  last_tick = tick;
+
+  struct sample sample = {
+      .at = now,
+      .bytes = bytes - last_bytes,
+      .sessions = sessions - last_sessions,
+      .errors = errors - last_errors,
+      .active = active,
+  };
+  sample.peak_bytes = sample.bytes;
+  push_second(&sample);
+  last_bytes = bytes;
+  last_sessions = sessions;
+  last_errors = errors;
+
+  selector_timer_add(s, TICK_MS, sample_tick, NULL);
+}
+
+bool history_init(fd_selector s) {
+  last_bytes = get_transferred_bytes();
+  last_sessions = get_historic_connections();
+  last_errors = get_session_errors();
+  last_tick = monotonic_s();
+  return selector_timer_add(s, TICK_MS, sample_tick, NULL) != 0;
+}
+
+bool history_window(struct history_cursor *c, uint64_t window) {
+  if (window == 0 || window > (uint64_t)HISTORY_MINUTES * 60) {
+    return false;
+  }
+  struct ring *r = window <= HISTORY_SECONDS ? &seconds : &minutes;
+  uint64_t wanted = (window + r->resolution - 1) / r->resolution;
+  c->resolution = r->resolution;
+  c->end = r->count;
+  c->next = r->count > wanted ? r->count - wanted : 0;
+  c->header_done = false;
+  return true;
+}
+
+bool history_render_done(const struct history_cursor *c) {
+  return c->header_done && c->next >= c->end;
+}
+
+size_t history_render(struct history_cursor *c, char *out, size_t size) {
+  struct ring *r = c->resolution == 1 ? &seconds : &minutes;
+  size_t pos = 0;
+  if (!c->header_done) {
+    // La ventana arranca en la más vieja que no se pisa con la próxima
+    // muestra: así `samples' cuenta las líneas que siguen
+    uint64_t oldest = r->count > r->capacity ? r->count - r->capacity + 1 : 0;
+    if (c->next < oldest) {
+      c->next = oldest < c->end ? oldest : c->end;
+    }
+    int len = snprintf(out, size, "+OK history resolution=%us samples=%llu\r\n",
+                       c->resolution, (unsigned long long)(c->end - c->next));
+    if ((size_t)len >= size) {
+      return 0;
+    }
+    pos = len;
+    c->header_done = true;
+  }
+  for (; c->next < c->end; c->next++) {
+    // sólo si el cliente leyó más lento que el muestreo: esas ya no están y
+    // la respuesta queda con menos líneas que las anunciadas
+    if (r->count - c->next > r->capacity) {
+      continue;
+    }
+    const struct sample *s = &r->samples[c->next % r->capacity];
+    // Formato: hora bytes=n sessions=n errors=n active=n peak_bytes=n\r\n
+    int len = snprintf(out + pos, size - pos,
+                       "%lld bytes=%llu sessions=%llu errors=%llu active=%llu "
+                       "peak_bytes=%llu\r\n",
+                       (long long)s->at, (unsigned long long)s->bytes,
+                       (unsigned long long)s->sessions,
+                       (unsigned long long)s->errors,
+                       (unsigned long long)s->active,
+                       (unsigned long long)s->peak_bytes);
+    if ((size_t)len >= size - pos) {
+      break;
+    }
+    pos += len;
+  }
+  return pos;
+}
@@ -0,0 +1,53 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "lib/selector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * history.c - historia reciente de tráfico y sesiones
+ *
+ * Un timer del selector toma una muestra por segundo de los contadores
+ * globales: bytes copiados, sesiones nuevas, sesiones que terminaron en
+ * error y sesiones activas. Se guardan en dos anillos de tamaño fijo: la
+ * última hora segundo a segundo y el último día minuto a minuto. Una muestra
+ * de un minuto suma las de sus segundos y guarda además el pico de bytes y
+ * de sesiones activas de esos segundos, para que las ráfagas no se pierdan
+ * en el promedio.
+ *
+ * Sólo desde el hilo del selector.
+ */
+#define HISTORY_SECONDS 3600
+#define HISTORY_MINUTES 1440
+
+/** arranca el muestreo */
+bool history_init(fd_selector s);
+
+/** recorrido de una ventana de la historia */
+struct history_cursor {
+  /** 1 o 60 segundos por muestra */
+  unsigned resolution;
+  /** próxima muestra y fin de la ventana, en número de muestra */
+  uint64_t next, end;
+  bool header_done;
+};
+
+/**
+ * Prepara el recorrido de los últimos `seconds' segundos: con resolución de
+ * un segundo si entran en la última hora, si no de un minuto. Retorna false
+ * si la ventana es 0 o más larga que un día.
+ */
+bool history_window(struct history_cursor *c, uint64_t seconds);
+
+/**
+ * Escribe en `out' las líneas que entren enteras, de la más vieja a la más
+ * nueva, y avanza el cursor. Retorna los bytes escritos.
+ */
+size_t history_render(struct history_cursor *c, char *out, size_t size);
+
+/** true si ya se escribió toda la ventana */
+bool history_render_done(const struct history_cursor *c);
+
+#endif
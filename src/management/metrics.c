@@ -1,51 +1,460 @@
 #include "metrics.h"
+#include "histogram.h"
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-static uint64_t historic_connections;
-static uint64_t current_connections;
-static uint64_t transferred_bytes;
+/**
+ * Cada hilo suma en su propia porción de los contadores, alineada a una línea
+ * de caché: los incrementos no compiten por la misma línea aunque varios
+ * hilos cuenten lo mismo. Leer un valor es sumar todas las porciones.
+ *
+ * Los incrementos son atómicos pero relajados: si hay más hilos que
+ * porciones, dos comparten una sin perder cuentas.
+ */
+#define METRICS_SHARDS 16
+#define CACHE_LINE 64
+
+struct shard {
+  alignas(CACHE_LINE) _Atomic uint64_t values[METRICS_MAX];
+};
+
+static struct shard shards[METRICS_SHARDS];
+
+static _Atomic unsigned next_shard;
+static _Thread_local unsigned thread_shard = UINT_MAX;
+
+static uint64_t loop_wakeups(void);
+static uint64_t loop_dispatches(void);
+static uint64_t interest_calls(void);
+static uint64_t interest_noops(void);
+static uint64_t bytes_per_recv(void);
+static uint64_t bytes_per_send(void);
+static uint64_t bytes_per_wakeup(void);
+
+/** métricas registradas: las propias, en el orden de la salida, y después
+ * las que registren los demás módulos */
+static struct {
+  const char *name;
+  uint64_t (*read)(void); // NULL si se suman las porciones
+  bool gauge;             // sube y baja: no es un contador
+} registry[METRICS_MAX] = {
+    [HISTORIC_CONNECTIONS] = {"total connections", NULL},
+    [CURRENT_CONNECTIONS] = {"current connections", NULL, true},
+    [TRANSFERRED_BYTES] = {"total transferred  bytes", NULL},
+    [DNS_CACHE_HITS] = {"dns cache hits", NULL},
+    [DNS_CACHE_MISSES] = {"dns cache misses", NULL},
+    [DNS_REFRESHES] = {"dns refreshes", NULL},
+    [DNS_REFRESH_HITS] = {"dns refresh hits", NULL},
+    [DNS_DROPPED_LOOKUPS] = {"dns dropped lookups", NULL},
+    [TFO_CONNECT_HITS] = {"tfo origin hits", NULL},
+    [TFO_CONNECT_MISSES] = {"tfo origin misses", NULL},
+    [TFO_ACCEPTS] = {"tfo client accepts", NULL},
+    [SESSION_ERRORS] = {"session errors", NULL},
+    [COPY_RECVS] = {"copy recv calls", NULL},
+    [COPY_RECV_EAGAINS] = {"copy recv eagain", NULL},
+    [COPY_SENDS] = {"copy send calls", NULL},
+    [COPY_SEND_EAGAINS] = {"copy send eagain", NULL},
+    [LOOP_WAKEUPS] = {"loop wakeups", loop_wakeups},
+    [LOOP_DISPATCHES] = {"loop dispatches", loop_dispatches},
+    [INTEREST_CALLS] = {"interest calls", interest_calls},
+    [INTEREST_NOOPS] = {"interest noops", interest_noops},
+    [COPY_BYTES_PER_RECV] = {"copy bytes per recv", bytes_per_recv, true},
+    [COPY_BYTES_PER_SEND] = {"copy bytes per send", bytes_per_send, true},
+    [COPY_BYTES_PER_WAKEUP] = {"copy bytes per wakeup", bytes_per_wakeup,
+                               true},
+};
+
+/** selector del que salen las métricas del loop */
+static fd_selector loop = NULL;
+
+static struct histogram latencies[LATENCY_METRICS];
+
+static const char *latency_names[] = {
+    [LATENCY_HELLO] = "hello",
+    [LATENCY_AUTH] = "auth",
+    [LATENCY_RESOLVE] = "resolve",
+    [LATENCY_CONNECT] = "connect",
+    [LATENCY_FIRST_BYTE] = "first byte",
+};
+
+static _Atomic unsigned registered = BUILTIN_METRICS;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct shard *my_shard(void) {
+  if (thread_shard == UINT_MAX) {
+    thread_shard = atomic_fetch_add_explicit(&next_shard, 1,
+                                             memory_order_relaxed) %
+                   METRICS_SHARDS;
+  }
+  return &shards[thread_shard];
+}
+
+static metric_id metrics_register(const char *name, uint64_t (*read)(void),
+                                  bool gauge) {
+  metric_id id = METRIC_INVALID;
+  pthread_mutex_lock(&registry_mutex);
+  unsigned n = atomic_load_explicit(&registered, memory_order_relaxed);
+  if (n < METRICS_MAX) {
+    registry[n].name = name;
+    registry[n].read = read;
+    registry[n].gauge = gauge;
+    id = n;
+    // publica el nombre antes que la cantidad para quien lee sin el mutex
+    atomic_store_explicit(&registered, n + 1, memory_order_release);
+  }
+  pthread_mutex_unlock(&registry_mutex);
+  return id;
+}
+
+metric_id metrics_register_counter(const char *name) {
+  return metrics_register(name, NULL, false);
+}
+
+metric_id metrics_register_level(const char *name) {
+  return metrics_register(name, NULL, true);
+}
+
+metric_id metrics_register_gauge(const char *name, uint64_t (*read)(void)) {
+  return read == NULL ? METRIC_INVALID : metrics_register(name, read, true);
+}
+
+void metrics_add(metric_id id, uint64_t delta) {
+  if (id < METRICS_MAX) {
+    atomic_fetch_add_explicit(&my_shard()->values[id], delta,
+                              memory_order_relaxed);
+  }
+}
+
+// Los decrementos se suman en complemento a dos: cada porción puede dar la
+// vuelta, pero la suma de todas es la correcta
+void metrics_sub(metric_id id, uint64_t delta) { metrics_add(id, -delta); }
+
+uint64_t metrics_value(metric_id id) {
+  if (id >= METRICS_MAX) {
+    return 0;
+  }
+  if (registry[id].read != NULL) {
+    return registry[id].read();
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < METRICS_SHARDS; i++) {
+    total += atomic_load_explicit(&shards[i].values[id], memory_order_relaxed);
+  }
+  return total;
+}
+
+unsigned metrics_count(void) {
+  return atomic_load_explicit(&registered, memory_order_acquire);
+}
+
+const char *metrics_name(metric_id id) {
+  return id < metrics_count() ? registry[id].name : NULL;
+}
+
+bool metrics_is_gauge(metric_id id) {
+  return id < metrics_count() && registry[id].gauge;
+}
+
+uint64_t latency_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_record(enum latency_metric m, uint64_t since) {
+  uint64_t now = latency_clock();
+  histogram_record(&latencies[m], now > since ? now - since : 0);
+}
 
 void init_metrics() {
-  historic_connections = 0;
-  current_connections = 0;
-  transferred_bytes = 0;
+  for (size_t i = 0; i < METRICS_SHARDS; i++) {
+    for (size_t j = 0; j < METRICS_MAX; j++) {
+      atomic_store_explicit(&shards[i].values[j], 0, memory_order_relaxed);
+    }
+  }
+  for (size_t i = 0; i < LATENCY_METRICS; i++) {
+    for (size_t j = 0; j < HISTOGRAM_BUCKETS; j++) {
+      atomic_store_explicit(&latencies[i].counts[j], 0, memory_order_relaxed);
+    }
+  }
+}
+
+uint64_t get_historic_connections() {
+  return metrics_value(HISTORIC_CONNECTIONS);
+}
+
+uint64_t get_current_connections() {
+  return metrics_value(CURRENT_CONNECTIONS);
+}
+
+uint64_t get_transferred_bytes() { return metrics_value(TRANSFERRED_BYTES); }
+
+uint64_t get_dns_cache_hits() { return metrics_value(DNS_CACHE_HITS); }
+
+uint64_t get_dns_cache_misses() { return metrics_value(DNS_CACHE_MISSES); }
+
+uint64_t get_dns_refreshes() { return metrics_value(DNS_REFRESHES); }
+
+uint64_t get_dns_refresh_hits() { return metrics_value(DNS_REFRESH_HITS); }
+
+uint64_t get_dns_dropped_lookups() {
+  return metrics_value(DNS_DROPPED_LOOKUPS);
 }
 
-uint64_t get_historic_connections() { return historic_connections; }
+uint64_t get_tfo_connect_hits() { return metrics_value(TFO_CONNECT_HITS); }
 
-uint64_t get_current_connections() { return current_connections; }
+uint64_t get_tfo_connect_misses() { return metrics_value(TFO_CONNECT_MISSES); }
 
-uint64_t get_transferred_bytes() { return transferred_bytes; }
+uint64_t get_tfo_accepts() { return metrics_value(TFO_ACCEPTS); }
 
 void start_connection() {
-  historic_connections++;
-  current_connections++;
+  metrics_add(HISTORIC_CONNECTIONS, 1);
+  metrics_add(CURRENT_CONNECTIONS, 1);
+}
+
+void end_connection() { metrics_sub(CURRENT_CONNECTIONS, 1); }
+
+void transfer_bytes(uint64_t bytes) { metrics_add(TRANSFERRED_BYTES, bytes); }
+
+void dns_cache_hit() { metrics_add(DNS_CACHE_HITS, 1); }
+
+void dns_cache_miss() { metrics_add(DNS_CACHE_MISSES, 1); }
+
+void dns_refresh_started() { metrics_add(DNS_REFRESHES, 1); }
+
+// pedido servido por una entrada que se renovó antes de vencer
+void dns_refresh_hit() { metrics_add(DNS_REFRESH_HITS, 1); }
+
+// llamado desde los hilos resolvedores
+void dns_lookup_dropped() { metrics_add(DNS_DROPPED_LOOKUPS, 1); }
+
+// connect al origen con Fast Open: hit si el origen aceptó los datos del SYN,
+// miss si no había cookie o la rechazó y los datos salieron tras el handshake
+void tfo_connect_result(int hit) {
+  metrics_add(hit ? TFO_CONNECT_HITS : TFO_CONNECT_MISSES, 1);
 }
 
-void end_connection() {
-  if (current_connections > 0)
-    current_connections--;
+// cliente que nos mandó datos en el SYN
+void tfo_accept() { metrics_add(TFO_ACCEPTS, 1); }
+
+uint64_t get_session_errors() { return metrics_value(SESSION_ERRORS); }
+
+// sesión que terminó en ERROR (incluye las rechazadas con una respuesta)
+void session_error() { metrics_add(SESSION_ERRORS, 1); }
+
+void copy_recv_call(bool would_block) {
+  metrics_add(COPY_RECVS, 1);
+  if (would_block) {
+    metrics_add(COPY_RECV_EAGAINS, 1);
+  }
 }
 
-void transfer_bytes(uint64_t bytes) { transferred_bytes += bytes; }
+void copy_send_call(bool would_block) {
+  metrics_add(COPY_SENDS, 1);
+  if (would_block) {
+    metrics_add(COPY_SEND_EAGAINS, 1);
+  }
+}
+
+void metrics_watch_loop(fd_selector s) { loop = s; }
 
-uint8_t *write_metrics(void) {
-  uint8_t *out = malloc(BUFSIZ);
-  if (!out)
-    return NULL;
+// Los contadores del selector no son atómicos: se leen desde su hilo, que
+// es el que atiende METRICS y GET /metrics
+static struct selector_stats loop_stats(void) {
+  struct selector_stats stats = {0};
+  if (loop != NULL) {
+    selector_get_stats(loop, &stats);
+  }
+  return stats;
+}
 
-  uint64_t total = get_historic_connections();
-  uint64_t current = get_current_connections();
-  uint64_t bytes = get_transferred_bytes();
+static uint64_t loop_wakeups(void) { return loop_stats().wakeups; }
 
-  snprintf((char *)out, BUFSIZ,
-           "+OK metrics\r\n"
-           "total connections: %llu\r\n"
-           "current connections: %llu\r\n"
-           "total transferred  bytes: %llu\r\n",
-           (unsigned long long)total, (unsigned long long)current,
-           (unsigned long long)bytes);
+static uint64_t loop_dispatches(void) { return loop_stats().dispatches; }
 
-  return out;
-}
\ No newline at end of file
+static uint64_t interest_calls(void) { return loop_stats().interest_calls; }
+
+static uint64_t interest_noops(void) { return loop_stats().interest_noops; }
+
+// Promedios desde el arranque: cuánto mueve cada syscall o despertar. Las
+// tasas recientes salen de los contadores (ej. rate() en Prometheus)
+static uint64_t per(uint64_t bytes, uint64_t calls) {
+  return calls == 0 ? 0 : bytes / calls;
+}
+
+static uint64_t bytes_per_recv(void) {
+  return per(metrics_value(TRANSFERRED_BYTES), metrics_value(COPY_RECVS));
+}
+
+// Lo que se recibe se envía: los bytes transferidos sirven para los dos
+static uint64_t bytes_per_send(void) {
+  return per(metrics_value(TRANSFERRED_BYTES), metrics_value(COPY_SENDS));
+}
+
+static uint64_t bytes_per_wakeup(void) {
+  return per(metrics_value(TRANSFERRED_BYTES), loop_wakeups());
+}
+
+// Nombre de OpenMetrics a partir del nombre legible: "dns cache hits" pasa
+// a "socks5_dns_cache_hits"
+static void exposition_name(const char *name, char *out, size_t size) {
+  size_t pos = snprintf(out, size, "socks5_");
+  bool separator = false;
+  for (const char *c = name; *c != '\0' && pos + 2 < size; c++) {
+    if (isalnum((unsigned char)*c)) {
+      if (separator) {
+        out[pos++] = '_';
+      }
+      out[pos++] = tolower((unsigned char)*c);
+      separator = false;
+    } else {
+      separator = pos > strlen("socks5_");
+    }
+  }
+  out[pos] = '\0';
+}
+
+enum section {
+  SECTION_HEADER,
+  SECTION_REGISTRY,
+  SECTION_LATENCIES,
+  SECTION_TRAILER,
+  SECTION_END,
+};
+
+void metrics_cursor_init(struct metrics_cursor *c, enum metrics_format f) {
+  c->format = f;
+  c->section = SECTION_HEADER;
+  c->index = 0;
+}
+
+bool metrics_render_done(const struct metrics_cursor *c) {
+  return c->section == SECTION_END;
+}
+
+static int render_value(enum metrics_format f, metric_id id, char *out,
+                        size_t size) {
+  unsigned long long value = metrics_value(id);
+  if (f == METRICS_TEXT) {
+    return snprintf(out, size, "%s: %llu\r\n", registry[id].name, value);
+  }
+  char name[96];
+  exposition_name(registry[id].name, name, sizeof(name));
+  if (registry[id].gauge) {
+    return snprintf(out, size, "# TYPE %s gauge\n%s %llu\n", name, name,
+                    value);
+  }
+  return snprintf(out, size, "# TYPE %s counter\n%s_total %llu\n", name, name,
+                  value);
+}
+
+// Los buckets de OpenMetrics son las potencias de dos en microsegundos, que
+// coinciden con bordes de los buckets del histograma: cada acumulado cuenta
+// exactamente los valores menores al borde (sólo difiere de `le' en los que
+// caen justo en el borde)
+static int render_latency(enum metrics_format f, unsigned i, char *out,
+                          size_t size) {
+  const struct histogram *h = &latencies[i];
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total = histogram_snapshot(h, counts);
+
+  if (f == METRICS_TEXT) {
+    return snprintf(
+        out, size,
+        "%s latency us: count=%llu p50=%llu p90=%llu p99=%llu p999=%llu\r\n",
+        latency_names[i], (unsigned long long)total,
+        (unsigned long long)histogram_snapshot_percentile(counts, total, 0.50),
+        (unsigned long long)histogram_snapshot_percentile(counts, total, 0.90),
+        (unsigned long long)histogram_snapshot_percentile(counts, total, 0.99),
+        (unsigned long long)histogram_snapshot_percentile(counts, total,
+                                                          0.999));
+  }
+
+  char name[96];
+  char display[64];
+  snprintf(display, sizeof(display), "%s latency seconds", latency_names[i]);
+  exposition_name(display, name, sizeof(name));
+  size_t pos = snprintf(out, size, "# TYPE %s histogram\n", name);
+  uint64_t below = 0;
+  unsigned bucket = 0;
+  for (unsigned bits = 0; bits < HISTOGRAM_MAX_BITS; bits++) {
+    uint64_t edge = 1ULL << bits;
+    for (unsigned end = histogram_bucket(edge); bucket < end; bucket++) {
+      below += counts[bucket];
+    }
+    pos += snprintf(out + (pos < size ? pos : size),
+                    pos < size ? size - pos : 0,
+                    "%s_bucket{le=\"%llu.%06llu\"} %llu\n", name,
+                    (unsigned long long)(edge / 1000000),
+                    (unsigned long long)(edge % 1000000),
+                    (unsigned long long)below);
+  }
+  uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+  pos += snprintf(out + (pos < size ? pos : size), pos < size ? size - pos : 0,
+                  "%s_bucket{le=\"+Inf\"} %llu\n%s_count %llu\n"
+                  "%s_sum %llu.%06llu\n",
+                  name, (unsigned long long)total, name,
+                  (unsigned long long)total, name,
+                  (unsigned long long)(sum / 1000000),
+                  (unsigned long long)(sum % 1000000));
+  return pos;
+}
+
+// Escribe el elemento actual del cursor, o retorna -1 si no hay más en la
+// sección. Como snprintf, retorna lo que ocuparía aunque no entre
+static int render_item(struct metrics_cursor *c, char *out, size_t size) {
+  switch (c->section) {
+  case SECTION_HEADER:
+    if (c->index > 0) {
+      return -1;
+    }
+    return c->format == METRICS_TEXT ? snprintf(out, size, "+OK metrics\r\n")
+                                     : snprintf(out, size, "%s", "");
+  case SECTION_REGISTRY:
+    if (c->index >= atomic_load_explicit(&registered, memory_order_acquire)) {
+      return -1;
+    }
+    return render_value(c->format, c->index, out, size);
+  case SECTION_LATENCIES:
+    if (c->index >= LATENCY_METRICS) {
+      return -1;
+    }
+    return render_latency(c->format, c->index, out, size);
+  case SECTION_TRAILER:
+    if (c->index > 0) {
+      return -1;
+    }
+    return c->format == METRICS_OPENMETRICS ? snprintf(out, size, "# EOF\n")
+                                            : snprintf(out, size, "%s", "");
+  default:
+    return -1;
+  }
+}
+
+size_t metrics_render(struct metrics_cursor *c, char *out, size_t size) {
+  size_t pos = 0;
+  while (c->section != SECTION_END) {
+    int len = render_item(c, out + pos, size - pos);
+    if (len < 0) {
+      c->section++;
+      c->index = 0;
+      continue;
+    }
+    if ((size_t)len >= size - pos) {
+      break; // no entra: lo reintentamos en la próxima llamada
+    }
+    pos += len;
+    c->index++;
+  }
+  if (pos < size) {
+    out[pos] = '\0';
+  }
+  return pos;
+}
@@ -1,5 +1,8 @@
 #ifndef METRICS_H
 #define METRICS_H
+#include "lib/selector.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
@@ -10,11 +13,123 @@ typedef enum {
   LIST_USERS,
   SHOW_LOGS,
   SET_BUFFER,
+  ADD_HOST,
+  DEL_HOST,
+  LIST_HOSTS,
+  SET_LIMIT,
+  LIST_LIMITS,
+  SET_CAPACITY,
+  SET_SOCKOPT,
+  LIST_SOCKOPTS,
+  TOP_DESTINATIONS,
+  TOP_USERS,
+  METRICS_HISTORY,
+  LIST_SESSIONS,
+  KILL_SESSION,
+  UNIQUES,
   QUIT,
+  ARG_TOO_LONG,
   UNKNOWN,
 } mng_cmd;
 
-uint8_t *write_metrics(void);
+/** máximo de métricas, contando las propias y las registradas */
+#define METRICS_MAX 64
+#define METRIC_INVALID METRICS_MAX
+
+typedef unsigned metric_id;
+
+/** métricas propias, en el orden en que las lista write_metrics */
+enum builtin_metric {
+  HISTORIC_CONNECTIONS,
+  CURRENT_CONNECTIONS,
+  TRANSFERRED_BYTES,
+  DNS_CACHE_HITS,
+  DNS_CACHE_MISSES,
+  DNS_REFRESHES,
+  DNS_REFRESH_HITS,
+  DNS_DROPPED_LOOKUPS,
+  TFO_CONNECT_HITS,
+  TFO_CONNECT_MISSES,
+  TFO_ACCEPTS,
+  SESSION_ERRORS,
+  COPY_RECVS,
+  COPY_RECV_EAGAINS,
+  COPY_SENDS,
+  COPY_SEND_EAGAINS,
+  LOOP_WAKEUPS,
+  LOOP_DISPATCHES,
+  INTEREST_CALLS,
+  INTEREST_NOOPS,
+  COPY_BYTES_PER_RECV,
+  COPY_BYTES_PER_SEND,
+  COPY_BYTES_PER_WAKEUP,
+  BUILTIN_METRICS,
+};
+
+/**
+ * Registra un contador con `name' (que debe vivir mientras corra el
+ * servidor) y lo agrega a la salida de write_metrics. Devuelve
+ * METRIC_INVALID si no hay lugar; sumarle a ese id no tiene efecto.
+ * Se puede llamar desde cualquier hilo.
+ */
+metric_id metrics_register_counter(const char *name);
+/** igual, para un valor que sube y baja con metrics_add/metrics_sub */
+metric_id metrics_register_level(const char *name);
+/** igual, para un valor que se calcula al leerlo */
+metric_id metrics_register_gauge(const char *name, uint64_t (*read)(void));
+/** suma a la porción del hilo que llama: sin locks ni líneas compartidas */
+void metrics_add(metric_id id, uint64_t delta);
+void metrics_sub(metric_id id, uint64_t delta);
+/** suma de todas las porciones */
+uint64_t metrics_value(metric_id id);
+/** métricas registradas: los ids van de 0 a metrics_count() - 1 */
+unsigned metrics_count(void);
+const char *metrics_name(metric_id id);
+bool metrics_is_gauge(metric_id id);
+
+/** etapas del armado de una sesión cuya duración se mide */
+enum latency_metric {
+  LATENCY_HELLO,      // accept hasta el saludo completo
+  LATENCY_AUTH,       // verificación de las credenciales
+  LATENCY_RESOLVE,    // REQUEST_RESOLVE
+  LATENCY_CONNECT,    // REQUEST_CONNECT
+  LATENCY_FIRST_BYTE, // conexión al origen hasta su primer byte en COPY
+  LATENCY_METRICS,
+};
+
+/** reloj de las latencias: microsegundos de CLOCK_MONOTONIC */
+uint64_t latency_clock(void);
+/** registra lo que pasó desde `since' (tomado con latency_clock) */
+void latency_record(enum latency_metric m, uint64_t since);
+
+enum metrics_format {
+  /** líneas `nombre: valor' del comando METRICS */
+  METRICS_TEXT,
+  /** formato de exposición de OpenMetrics, para GET /metrics */
+  METRICS_OPENMETRICS,
+};
+
+/** posición de un recorrido de las métricas */
+struct metrics_cursor {
+  enum metrics_format format;
+  unsigned section, index;
+};
+
+void metrics_cursor_init(struct metrics_cursor *c, enum metrics_format f);
+
+/**
+ * Escribe en `out' las líneas que entren enteras desde la posición de `c' y
+ * la avanza. Retorna los bytes escritos (sin terminador): se puede ir
+ * enviando la salida de a partes sin armarla entera en memoria. Con `size'
+ * de al menos METRICS_ITEM_MAX siempre avanza.
+ */
+size_t metrics_render(struct metrics_cursor *c, char *out, size_t size);
+
+/** true si ya se escribió todo */
+bool metrics_render_done(const struct metrics_cursor *c);
+
+/** lo más que ocupa una métrica (un histograma en OpenMetrics) */
+#define METRICS_ITEM_MAX 4096
 void init_metrics();
 uint64_t get_historic_connections();
 uint64_t get_current_connections();
@@ -22,5 +137,27 @@ uint64_t get_transferred_bytes();
 void start_connection();
 void end_connection();
 void transfer_bytes(uint64_t bytes);
+uint64_t get_dns_cache_hits();
+uint64_t get_dns_cache_misses();
+uint64_t get_dns_refreshes();
+uint64_t get_dns_refresh_hits();
+uint64_t get_dns_dropped_lookups();
+void dns_cache_hit();
+void dns_cache_miss();
+void dns_refresh_started();
+void dns_refresh_hit();
+void dns_lookup_dropped();
+uint64_t get_tfo_connect_hits();
+uint64_t get_tfo_connect_misses();
+uint64_t get_tfo_accepts();
+void tfo_connect_result(int hit);
+void tfo_accept();
+uint64_t get_session_errors();
+void session_error();
+/** syscalls de la etapa de copia; `would_block' si volvió con EAGAIN */
+void copy_recv_call(bool would_block);
+void copy_send_call(bool would_block);
+/** toma la actividad de `s' para las métricas `loop' e `interest' */
+void metrics_watch_loop(fd_selector s);
 
 #endif
\ No newline at end of file
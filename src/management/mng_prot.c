@@ -3,20 +3,38 @@
 #include "mng_auth.h"
 #include "mng_users.h"
 #include "selector.h"
+#include "socks5/accounts.h"
+#include "socks5/auth_verify.h"
+#include "socks5/destinations.h"
+#include "socks5/dns.h"
+#include "socks5/scheduler.h"
+#include "socks5/sessions.h"
+#include "socks5/sockopts.h"
+#include "socks5/uniques.h"
 #include "stm.h"
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 static unsigned mng_auth_read(struct selector_key *key);
+static unsigned mng_auth_verified(struct selector_key *key);
 static unsigned mng_auth_write(struct selector_key *key);
 static unsigned mng_cmd_read(struct selector_key *key);
+static unsigned mng_user_derived(struct selector_key *key);
 static unsigned mng_cmd_write(struct selector_key *key);
 static unsigned mng_close_connection(struct selector_key *key);
+static unsigned http_read(struct selector_key *key);
+static unsigned http_process(struct selector_key *key);
+static unsigned http_write(struct selector_key *key);
+static bool stream_done(metrics_t *m);
+static bool stream_fill(metrics_t *m);
 static unsigned mng_close_connection_error(struct selector_key *key);
 void send_reply(struct selector_key *key, const char *msj);
+static void send_listing(struct selector_key *key, const char *header,
+                         const char *list);
 
 static const struct state_definition metp_states[] = {
     [MNG_AUTH] =
@@ -24,6 +42,11 @@ static const struct state_definition metp_states[] = {
             .state = MNG_AUTH,
             .on_read_ready = mng_auth_read,
         },
+    [MNG_AUTH_VERIFY] =
+        {
+            .state = MNG_AUTH_VERIFY,
+            .on_block_ready = mng_auth_verified,
+        },
     [MNG_AUTH_REPLY] =
         {
             .state = MNG_AUTH_REPLY,
@@ -34,11 +57,26 @@ static const struct state_definition metp_states[] = {
             .state = MNG_CMD_READ,
             .on_read_ready = mng_cmd_read,
         },
+    [MNG_CMD_ADD_USER] =
+        {
+            .state = MNG_CMD_ADD_USER,
+            .on_block_ready = mng_user_derived,
+        },
     [MNG_CMD_WRITE] =
         {
             .state = MNG_CMD_WRITE,
             .on_write_ready = mng_cmd_write,
         },
+    [MNG_HTTP_READ] =
+        {
+            .state = MNG_HTTP_READ,
+            .on_read_ready = http_read,
+        },
+    [MNG_HTTP_WRITE] =
+        {
+            .state = MNG_HTTP_WRITE,
+            .on_write_ready = http_write,
+        },
     [MNG_DONE] =
         {
             .state = MNG_DONE,
@@ -51,11 +89,13 @@ static const struct state_definition metp_states[] = {
 
 static void mng_read(struct selector_key *key);
 static void mng_write(struct selector_key *key);
+static void mng_block(struct selector_key *key);
 static void mng_close(struct selector_key *key);
 
 static const struct fd_handler mng_handler = {
     .handle_read = mng_read,
     .handle_write = mng_write,
+    .handle_block = mng_block,
     .handle_close = mng_close,
 };
 
@@ -75,10 +115,24 @@ static void mng_write(struct selector_key *key) {
   }
 }
 
+// Terminó un KDF delegado al pool
+static void mng_block(struct selector_key *key) {
+  metrics_t *m = key->data;
+  // El fd pudo haberse reutilizado por una conexión que no espera trabajos
+  if (m->auth_job == NULL) {
+    return;
+  }
+  unsigned state = stm_handler_block(&m->stm, key);
+  if (state == MNG_ERROR || state == MNG_DONE) {
+    selector_unregister_fd(key->s, key->fd);
+  }
+}
+
 static void mng_close(struct selector_key *key) {
   metrics_t *m = key->data;
   if (m == NULL)
     return;
+  auth_verify_release(m->auth_job);
   if (key->fd != -1) {
     close(key->fd);
   }
@@ -134,6 +188,19 @@ fail:
   }
 }
 
+static unsigned mng_auth_result(struct selector_key *key, bool success) {
+  metrics_t *m = key->data;
+  m->auth_success = success;
+  if (success) {
+    send_reply(key, "+OK authentication successful\r\n");
+  } else {
+    send_reply(key, "-ERR invalid credentials\r\n");
+    m->mng_auth_parser.state = AUTH_CMD_START;
+    buffer_reset(&m->read_buffer);
+  }
+  return MNG_AUTH_REPLY;
+}
+
 static unsigned mng_auth_read(struct selector_key *key) {
   metrics_t *m = key->data;
   bool errored = false;
@@ -155,6 +222,22 @@ static unsigned mng_auth_read(struct selector_key *key) {
   printf("MNG Read: %zd bytes\n", ret);
   buffer_write_adv(&m->read_buffer, ret);
 
+  // Un scraper HTTP se reconoce por sus primeros bytes: ningún comando
+  // empieza con "GET "
+  if (!m->sniffed) {
+    size_t n;
+    uint8_t *p = buffer_read_ptr(&m->read_buffer, &n);
+    size_t prefix = n < HTTP_GET_LEN ? n : HTTP_GET_LEN;
+    if (memcmp(p, HTTP_GET, prefix) == 0) {
+      if (n < HTTP_GET_LEN) {
+        return MNG_AUTH; // todavía no se puede saber
+      }
+      m->sniffed = true;
+      return http_process(key);
+    }
+    m->sniffed = true;
+  }
+
   // Parseamos
   mng_auth_state st =
       mng_auth_consume(&m->read_buffer, &m->mng_auth_parser, &errored);
@@ -165,8 +248,10 @@ static unsigned mng_auth_read(struct selector_key *key) {
   if (st == AUTH_CMD_DONE) {
     m->cmd = parse_command(m->mng_auth_parser.buffer, m->arg);
 
-    const char *response;
-    if (m->cmd != AUTH) {
+    if (m->cmd == ARG_TOO_LONG) {
+      m->auth_success = false;
+      send_reply(key, "-ERR argument too long\r\n");
+    } else if (m->cmd != AUTH) {
       m->auth_success = false;
       send_reply(key, "-ERR unknown command\r\n");
     } else {
@@ -194,16 +279,23 @@ static unsigned mng_auth_read(struct selector_key *key) {
         free(username);
         free(password);
 
-        m->auth_success = check_credentials(m->credentials.username, m->credentials.password);
-
-        if (m->auth_success) {
-          response = "+OK authentication successful\r\n";
-        } else {
-          response = "-ERR invalid credentials\r\n";
-          m->mng_auth_parser.state = AUTH_CMD_START;
-          buffer_reset(&m->read_buffer);
+        // El KDF corre en el pool salvo que las credenciales estén en la
+        // caché; un usuario inexistente también pasa por el pool, para
+        // tardar lo mismo
+        user_verifier v;
+        bool exists = get_user_verifier(m->credentials.username, &v);
+        if (exists && cached_credentials(m->credentials.username, &v,
+                                         m->credentials.password)) {
+          return mng_auth_result(key, true);
+        }
+        m->auth_job = auth_verify_start(key->s, key->fd, exists ? &v : NULL,
+                                        m->credentials.password);
+        if (m->auth_job == NULL) {
+          send_reply(key, "-ERR internal error\r\n");
+          return MNG_ERROR;
         }
-        send_reply(key, response);
+        selector_set_interest_key(key, OP_NOOP);
+        return MNG_AUTH_VERIFY;
       }
       selector_set_interest_key(key, OP_WRITE);
     }
@@ -212,6 +304,21 @@ static unsigned mng_auth_read(struct selector_key *key) {
   return MNG_AUTH;
 }
 
+static unsigned mng_auth_verified(struct selector_key *key) {
+  metrics_t *m = key->data;
+  bool success;
+  if (!auth_verify_done(m->auth_job, &success)) {
+    return MNG_AUTH_VERIFY;
+  }
+  if (success) {
+    success = auth_verify_accept(m->auth_job, m->credentials.username,
+                                 m->credentials.password);
+  }
+  auth_verify_release(m->auth_job);
+  m->auth_job = NULL;
+  return mng_auth_result(key, success);
+}
+
 static unsigned mng_auth_write(struct selector_key *key) {
   metrics_t *m = key->data;
   size_t count;
@@ -298,20 +405,19 @@ static unsigned mng_cmd_read(struct selector_key *key) {
     return MNG_CMD_WRITE;
 
   case METRICS: {
-    uint8_t *out = write_metrics();
-    size_t len = strlen((char *)out);
+    // Se escriben directo en el buffer de salida
+    struct metrics_cursor c;
+    metrics_cursor_init(&c, METRICS_TEXT);
     size_t space;
     uint8_t *dst = buffer_write_ptr(&m->write_buffer, &space);
-    if (space >= len) {
-      memcpy(dst, out, len);
-      buffer_write_adv(&m->write_buffer, len);
-      free(out);
-      selector_set_interest_key(key, OP_WRITE);
+    size_t len = metrics_render(&c, (char *)dst, space);
+    if (!metrics_render_done(&c)) {
+      send_reply(key, "-ERR buffer too small\r\n");
       return MNG_CMD_WRITE;
-    } else {
-      free(out);
-      return MNG_ERROR;
     }
+    buffer_write_adv(&m->write_buffer, len);
+    selector_set_interest_key(key, OP_WRITE);
+    return MNG_CMD_WRITE;
   }
   case ADD_USER: {
     char *username = NULL;
@@ -326,18 +432,17 @@ static unsigned mng_cmd_read(struct selector_key *key) {
       return MNG_CMD_WRITE;
     }
 
-    if (!add_user(username, password)) {
-      char tmp[BUFFER_SIZE];
-      snprintf(tmp, sizeof(tmp), "-ERR user %s already exist\r\n", username);
-      send_reply(key, tmp);
-    } else {
-      char tmp[BUFFER_SIZE];
-      snprintf(tmp, sizeof(tmp), "+OK user %s added correctly\r\n", username);
-      send_reply(key, tmp);
-    }
+    // El verificador se deriva en el pool; el alta sigue en
+    // mng_user_derived, que vuelve a parsear `arg'
+    m->auth_job = auth_derive_start(key->s, key->fd, password);
     free(username);
     free(password);
-    return MNG_CMD_WRITE;
+    if (m->auth_job == NULL) {
+      send_reply(key, "-ERR internal error\r\n");
+      return MNG_CMD_WRITE;
+    }
+    selector_set_interest_key(key, OP_NOOP);
+    return MNG_CMD_ADD_USER;
   }
 
   case DEL_USER: {
@@ -363,18 +468,8 @@ static unsigned mng_cmd_read(struct selector_key *key) {
       send_reply(key, "-ERR could not retrieve user list\r\n");
       return MNG_CMD_WRITE;
     }
-    size_t len = strlen(list);
-    uint8_t *dst;
-    size_t space;
-    dst = buffer_write_ptr(&m->write_buffer, &space);
-    if (space < len) {
-      free(list);
-      send_reply(key, "-ERR buffer too small\r\n");
-      return MNG_CMD_WRITE;
-    }
-    memcpy(dst, list, len);
-    buffer_write_adv(&m->write_buffer, len);
-    selector_set_interest_key(key, OP_WRITE);
+    send_listing(key, "+OK users\r\n", list);
+    free(list);
     return MNG_CMD_WRITE;
   }
 
@@ -445,15 +540,289 @@ static unsigned mng_cmd_read(struct selector_key *key) {
     return MNG_CMD_WRITE;
   }
 
+  case ADD_HOST: {
+    // formato host=addr[,addr...]
+    char *sep = strchr(m->arg, '=');
+    if (sep == NULL || sep == m->arg) {
+      send_reply(key,
+                 "-ERR invalid format, expected format HOST=ADDR[,ADDR]\r\n");
+      return MNG_CMD_WRITE;
+    }
+    *sep = '\0';
+    char tmp[BUFFER_SIZE];
+    if (!dns_hosts_add(m->arg, sep + 1)) {
+      snprintf(tmp, sizeof(tmp), "-ERR invalid addresses for host %s\r\n",
+               m->arg);
+    } else {
+      snprintf(tmp, sizeof(tmp), "+OK host %s added\r\n", m->arg);
+    }
+    send_reply(key, tmp);
+    return MNG_CMD_WRITE;
+  }
+
+  case DEL_HOST: {
+    char tmp[BUFFER_SIZE];
+    if (!dns_hosts_del(m->arg)) {
+      snprintf(tmp, sizeof(tmp), "-ERR host %s does not exist\r\n", m->arg);
+    } else {
+      snprintf(tmp, sizeof(tmp), "+OK host %s deleted\r\n", m->arg);
+    }
+    send_reply(key, tmp);
+    return MNG_CMD_WRITE;
+  }
+
+  case LIST_HOSTS: {
+    char *list = dns_hosts_list();
+    if (!list) {
+      send_reply(key, "-ERR could not retrieve host list\r\n");
+      return MNG_CMD_WRITE;
+    }
+    send_listing(key, "+OK hosts\r\n", list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
+  case SET_LIMIT: {
+    // formato usuario:max_sesiones:bytes_por_segundo[:peso] (0 = sin límite)
+    char user[ARG_SIZE];
+    unsigned max_sessions, weight = 1;
+    uint64_t rate;
+    int used = 0;
+    int fields = sscanf(m->arg, "%127[^:]:%u:%" SCNu64 "%n", user,
+                        &max_sessions, &rate, &used);
+    if (fields == 3 && m->arg[used] == ':') {
+      int more = 0;
+      if (sscanf(m->arg + used, ":%u%n", &weight, &more) != 1 || weight == 0)
+        fields = 0;
+      used += more;
+    }
+    if (fields != 3 || m->arg[used] != '\0') {
+      send_reply(key, "-ERR invalid format, expected format "
+                      "USER:MAX_SESSIONS:BYTES_PER_SEC[:WEIGHT]\r\n");
+      return MNG_CMD_WRITE;
+    }
+    struct account_limits limits = {
+        .max_sessions = max_sessions, .rate = rate, .weight = weight};
+    char tmp[BUFFER_SIZE];
+    if (!accounts_set_limits(user, &limits)) {
+      snprintf(tmp, sizeof(tmp), "-ERR could not set limits for %s\r\n",
+               user);
+    } else {
+      snprintf(tmp, sizeof(tmp), "+OK limits for %s set\r\n", user);
+    }
+    send_reply(key, tmp);
+    return MNG_CMD_WRITE;
+  }
+
+  case LIST_LIMITS: {
+    char *list = accounts_list();
+    if (!list) {
+      send_reply(key, "-ERR could not retrieve limits\r\n");
+      return MNG_CMD_WRITE;
+    }
+    char header[BUFFER_SIZE];
+    snprintf(header, sizeof(header), "+OK limits\r\ncapacity=%" PRIu64 "\r\n",
+             sched_get_capacity());
+    send_listing(key, header, list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
+  case SET_CAPACITY: {
+    char *end;
+    errno = 0;
+    unsigned long long capacity = strtoull(m->arg, &end, 10);
+    if (end == m->arg || *end != '\0' || errno == ERANGE ||
+        m->arg[0] == '-') {
+      send_reply(key, "-ERR invalid capacity\r\n");
+      return MNG_CMD_WRITE;
+    }
+    sched_set_capacity(capacity);
+    char tmp[BUFFER_SIZE];
+    snprintf(tmp, sizeof(tmp), "+OK capacity set to %llu bytes/s\r\n",
+             capacity);
+    send_reply(key, tmp);
+    return MNG_CMD_WRITE;
+  }
+
+  case SET_SOCKOPT: {
+    // aplica a las conexiones nuevas
+    switch (sockopts_set(m->arg)) {
+    case SOCKOPT_SUCCESS: {
+      char tmp[BUFFER_SIZE];
+      snprintf(tmp, sizeof(tmp), "+OK %s set\r\n", m->arg);
+      send_reply(key, tmp);
+      break;
+    }
+    case SOCKOPT_FORMAT:
+      send_reply(key, "-ERR invalid format, expected format "
+                      "LEG:OPTION=VALUE\r\n");
+      break;
+    case SOCKOPT_UNKNOWN:
+      send_reply(key, "-ERR unknown socket option\r\n");
+      break;
+    case SOCKOPT_VALUE:
+      send_reply(key, "-ERR invalid socket option value\r\n");
+      break;
+    }
+    return MNG_CMD_WRITE;
+  }
+
+  case LIST_SOCKOPTS: {
+    char *list = sockopts_list();
+    if (!list) {
+      send_reply(key, "-ERR could not retrieve socket options\r\n");
+      return MNG_CMD_WRITE;
+    }
+    send_listing(key, "+OK sockopts\r\n", list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
+  case TOP_DESTINATIONS:
+  case TOP_USERS: {
+    unsigned long count = TOP_DEFAULT;
+    if (m->arg[0] != '\0') {
+      char *end;
+      count = strtoul(m->arg, &end, 10);
+      if (*end != '\0' || m->arg[0] == '-' || count < 1 || count > TOP_MAX) {
+        send_reply(key, "-ERR invalid count (accepted counts: 1-50)\r\n");
+        return MNG_CMD_WRITE;
+      }
+    }
+    bool users = m->cmd == TOP_USERS;
+    char *list = users ? accounts_top(count) : destinations_top(count);
+    if (!list) {
+      send_reply(key, users ? "-ERR could not retrieve top users\r\n"
+                            : "-ERR could not retrieve top destinations\r\n");
+      return MNG_CMD_WRITE;
+    }
+    send_listing(key, users ? "+OK top users\r\n" : "+OK top destinations\r\n",
+                 list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
+  case METRICS_HISTORY: {
+    // ventana: número con unidad opcional s, m, h o d (por defecto segundos)
+    char *end;
+    errno = 0;
+    unsigned long long window = strtoull(m->arg, &end, 10);
+    unsigned long long unit = 1;
+    if (end != m->arg && end[0] != '\0' && end[1] == '\0') {
+      unit = end[0] == 's'   ? 1
+             : end[0] == 'm' ? 60
+             : end[0] == 'h' ? 3600
+             : end[0] == 'd' ? 86400
+                             : 0;
+      end++;
+    }
+    if (end == m->arg || *end != '\0' || errno == ERANGE || unit == 0 ||
+        m->arg[0] == '-' || window > UINT64_MAX / unit ||
+        !history_window(&m->history, window * unit)) {
+      send_reply(key, "-ERR invalid window (accepted windows: 1s-24h)\r\n");
+      return MNG_CMD_WRITE;
+    }
+    m->stream = STREAM_HISTORY;
+    if (!stream_fill(m)) {
+      m->stream = STREAM_NONE;
+      send_reply(key, "-ERR buffer too small\r\n");
+      return MNG_CMD_WRITE;
+    }
+    selector_set_interest_key(key, OP_WRITE);
+    return MNG_CMD_WRITE;
+  }
+
+  case LIST_SESSIONS: {
+    struct session_filter filter;
+    if (!sessions_parse_filter(m->arg, &filter)) {
+      send_reply(key, "-ERR invalid filter (accepted filters: user, state, "
+                      "age, bytes, after, limit)\r\n");
+      return MNG_CMD_WRITE;
+    }
+    size_t matched;
+    char *list = sessions_list(&filter, &matched);
+    if (!list) {
+      send_reply(key, "-ERR could not retrieve sessions\r\n");
+      return MNG_CMD_WRITE;
+    }
+    char header[64];
+    snprintf(header, sizeof(header), "+OK sessions %zu\r\n", matched);
+    send_listing(key, header, list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
+  case KILL_SESSION: {
+    char *end;
+    unsigned long long id = strtoull(m->arg, &end, 10);
+    char reply[96];
+    if (*end != '\0' || m->arg[0] < '0' || m->arg[0] > '9') {
+      send_reply(key, "-ERR invalid session id\r\n");
+    } else if (!sessions_kill(key->s, id)) {
+      snprintf(reply, sizeof(reply), "-ERR session %llu does not exist\r\n",
+               id);
+      send_reply(key, reply);
+    } else {
+      snprintf(reply, sizeof(reply), "+OK session %llu killed\r\n", id);
+      send_reply(key, reply);
+    }
+    return MNG_CMD_WRITE;
+  }
+
+  case UNIQUES: {
+    char *list = uniques_list();
+    if (!list) {
+      send_reply(key, "-ERR could not retrieve unique counts\r\n");
+      return MNG_CMD_WRITE;
+    }
+    send_listing(key, "+OK uniques\r\n", list);
+    free(list);
+    return MNG_CMD_WRITE;
+  }
+
   case QUIT:
     return MNG_DONE;
 
+  case ARG_TOO_LONG: {
+    char tmp[BUFFER_SIZE];
+    snprintf(tmp, sizeof(tmp), "-ERR argument too long (max %d characters)\r\n",
+             ARG_SIZE - 1);
+    send_reply(key, tmp);
+    return MNG_CMD_WRITE;
+  }
+
   default:
     send_reply(key, "-ERR unknown command\r\n");
     return MNG_CMD_WRITE;
   }
 }
 
+static unsigned mng_user_derived(struct selector_key *key) {
+  metrics_t *m = key->data;
+  bool success;
+  if (!auth_verify_done(m->auth_job, &success)) {
+    return MNG_CMD_ADD_USER;
+  }
+  char *username = NULL;
+  char *password = NULL;
+  parse_user(m->arg, &username, &password);
+  char tmp[BUFFER_SIZE];
+  if (!success || username == NULL) {
+    snprintf(tmp, sizeof(tmp), "-ERR internal error\r\n");
+  } else if (!add_user_verifier(username, auth_verify_verifier(m->auth_job))) {
+    snprintf(tmp, sizeof(tmp), "-ERR user %s already exist\r\n", username);
+  } else {
+    snprintf(tmp, sizeof(tmp), "+OK user %s added correctly\r\n", username);
+  }
+  auth_verify_release(m->auth_job);
+  m->auth_job = NULL;
+  free(username);
+  free(password);
+  send_reply(key, tmp);
+  return MNG_CMD_WRITE;
+}
+
 static unsigned mng_cmd_write(struct selector_key *key) {
   metrics_t *m = key->data;
   size_t count;
@@ -470,6 +839,11 @@ static unsigned mng_cmd_write(struct selector_key *key) {
   }
 
   if (!buffer_can_read(&m->write_buffer)) {
+    if (!stream_done(m)) {
+      // sigue la respuesta larga en curso
+      return stream_fill(m) ? MNG_CMD_WRITE : MNG_ERROR;
+    }
+    m->stream = STREAM_NONE;
     selector_set_interest_key(key, OP_READ);
     return MNG_CMD_READ;
   }
@@ -518,3 +892,149 @@ void send_reply(struct selector_key *key, const char *msg) {
   buffer_write_adv(&m->write_buffer, len);
   selector_set_interest_key(key, OP_WRITE);
 }
+
+// Respuesta de varias líneas: va entera o se reemplaza por un error
+static void send_listing(struct selector_key *key, const char *header,
+                         const char *list) {
+  metrics_t *m = key->data;
+  size_t header_len = strlen(header);
+  size_t len = strlen(list);
+  size_t space;
+  uint8_t *dst = buffer_write_ptr(&m->write_buffer, &space);
+  if (space < header_len + len) {
+    send_reply(key, "-ERR buffer too small\r\n");
+    return;
+  }
+  memcpy(dst, header, header_len);
+  memcpy(dst + header_len, list, len);
+  buffer_write_adv(&m->write_buffer, header_len + len);
+  selector_set_interest_key(key, OP_WRITE);
+}
+
+static bool stream_done(metrics_t *m) {
+  switch (m->stream) {
+  case STREAM_METRICS:
+    return metrics_render_done(&m->cursor);
+  case STREAM_HISTORY:
+    return history_render_done(&m->history);
+  default:
+    return true;
+  }
+}
+
+// Las respuestas largas se arman de a partes en el buffer de salida (vacío)
+// a medida que el socket las acepta: nunca hay una copia entera en memoria.
+// Retorna false si la próxima línea no entra ni en el buffer vacío
+static bool stream_fill(metrics_t *m) {
+  buffer_reset(&m->write_buffer);
+  size_t space;
+  char *dst = (char *)buffer_write_ptr(&m->write_buffer, &space);
+  size_t len = m->stream == STREAM_METRICS
+                   ? metrics_render(&m->cursor, dst, space)
+                   : history_render(&m->history, dst, space);
+  buffer_write_adv(&m->write_buffer, len);
+  return len > 0 || stream_done(m);
+}
+
+static unsigned http_read(struct selector_key *key) {
+  metrics_t *m = key->data;
+  size_t nbyte;
+  uint8_t *ptr = buffer_write_ptr(&m->read_buffer, &nbyte);
+  ssize_t ret = recv(key->fd, ptr, nbyte, 0);
+  if (ret < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return MNG_HTTP_READ;
+    }
+    return MNG_ERROR;
+  }
+  if (ret == 0) {
+    return MNG_DONE;
+  }
+  buffer_write_adv(&m->read_buffer, ret);
+  return http_process(key);
+}
+
+static unsigned http_reply(struct selector_key *key, const char *response,
+                           bool streaming) {
+  metrics_t *m = key->data;
+  buffer_reset(&m->write_buffer);
+  send_reply(key, response);
+  m->stream = STREAM_NONE;
+  if (streaming) {
+    m->stream = STREAM_METRICS;
+    metrics_cursor_init(&m->cursor, METRICS_OPENMETRICS);
+  }
+  return http_write(key);
+}
+
+// Espera el pedido completo y sólo mira la línea de pedido: el cuerpo de un
+// GET no nos interesa y la conexión se cierra al responder
+static unsigned http_process(struct selector_key *key) {
+  metrics_t *m = key->data;
+  size_t n;
+  uint8_t *p = buffer_read_ptr(&m->read_buffer, &n);
+
+  bool complete = false;
+  for (size_t i = 0; i + 4 <= n; i++) {
+    if (memcmp(p + i, "\r\n\r\n", 4) == 0) {
+      complete = true;
+      break;
+    }
+  }
+  if (!complete) {
+    if (!buffer_can_write(&m->read_buffer)) {
+      return http_reply(key,
+                        "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                        "Content-Length: 0\r\nConnection: close\r\n\r\n",
+                        false);
+    }
+    selector_set_interest_key(key, OP_READ);
+    return MNG_HTTP_READ;
+  }
+
+  // "GET /metrics HTTP/1.1": la ruta va hasta el espacio o la consulta
+  const char *path = (const char *)p + HTTP_GET_LEN;
+  size_t path_len = 0;
+  while (HTTP_GET_LEN + path_len < n && path[path_len] != ' ' &&
+         path[path_len] != '?' && path[path_len] != '\r') {
+    path_len++;
+  }
+  if (path_len != strlen("/metrics") ||
+      memcmp(path, "/metrics", path_len) != 0) {
+    return http_reply(key,
+                      "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                      "Connection: close\r\n\r\n",
+                      false);
+  }
+  return http_reply(key,
+                    "HTTP/1.1 200 OK\r\nContent-Type: application/"
+                    "openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                    "Connection: close\r\n\r\n",
+                    true);
+}
+
+static unsigned http_write(struct selector_key *key) {
+  metrics_t *m = key->data;
+  for (;;) {
+    if (!buffer_can_read(&m->write_buffer)) {
+      if (stream_done(m)) {
+        return MNG_DONE;
+      }
+      if (!stream_fill(m)) {
+        return MNG_ERROR;
+      }
+      continue;
+    }
+    size_t count;
+    uint8_t *out = buffer_read_ptr(&m->write_buffer, &count);
+    ssize_t w = send(m->fd, out, count, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        selector_set_interest_key(key, OP_WRITE);
+        return MNG_HTTP_WRITE;
+      }
+      return MNG_ERROR;
+    }
+    buffer_read_adv(&m->write_buffer, w);
+  }
+}
@@ -3,6 +3,7 @@
 #include "args.h"
 #include "lib/buffer.h"
 #include "lib/stm.h"
+#include "history.h"
 #include "metrics.h"
 #include "mng_auth.h"
 #include "mng_users.h"
@@ -10,17 +11,33 @@
 #include <stdlib.h>
 #define BUFFER_SIZE 256
 #define CMD_SIZE 16
-#define ARG_SIZE 128
+#define TOP_DEFAULT 10
+#define TOP_MAX 50
+#define HTTP_GET "GET "
+#define HTTP_GET_LEN 4
 
 typedef enum {
   MNG_AUTH,
+  MNG_AUTH_VERIFY, // KDF de AUTH en el pool
   MNG_AUTH_REPLY,
   MNG_CMD_READ,
+  MNG_CMD_ADD_USER, // KDF de ADD_USER en el pool
   MNG_CMD_WRITE,
+  MNG_HTTP_READ,
+  MNG_HTTP_WRITE,
   MNG_DONE,
   MNG_ERROR,
 } mng_state;
 
+/** respuestas que no entran en el buffer y se escriben a medida que se envían */
+typedef enum {
+  STREAM_NONE,
+  STREAM_METRICS,
+  STREAM_HISTORY,
+} mng_stream;
+
+struct auth_job;
+
 typedef struct {
   mng_cmd cmd;
   int fd;
@@ -33,6 +50,12 @@ typedef struct {
   char arg[ARG_SIZE];           // único argumento (user o user:pass)
   auth_credentials credentials; // aca guardamos user/pass recibidos
   bool auth_success;            // resultado de la validación de credenciales
+  struct auth_job *auth_job;    // KDF en curso en el pool
+
+  bool sniffed;                  // ya se sabe si la conexión es HTTP
+  mng_stream stream;             // respuesta larga que se arma de a partes
+  struct metrics_cursor cursor;  // por dónde va STREAM_METRICS
+  struct history_cursor history; // por dónde va STREAM_HISTORY
 
   struct state_machine stm;
 
@@ -1,15 +1,278 @@
 #include "mng_users.h"
-#include "../args.h"
+#include "lib/sha256.h"
+#include "userdb.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+// Tabla hash encadenada indexada por username. La cantidad de buckets es
+// potencia de 2 y se duplica cuando hay más usuarios que buckets, así la
+// búsqueda es O(1) sin importar la cantidad de usuarios.
+//
+// Los lectores nunca bloquean (RCU): toman la tabla con un load atómico y
+// recorren cadenas de nodos inmutables. Un alta agrega un nodo al frente de
+// su cadena y una baja copia los nodos que preceden al borrado; en los dos
+// casos la cadena nueva se publica con un único store en su bucket, así que
+// cada cambio cuesta O(1) esperado. Sólo al duplicarse se arma una tabla
+// nueva con todos los nodos (O(n), O(1) amortizado por alta). Lo que deja de
+// ser alcanzable se retira y se libera recién cuando todos los lectores
+// registrados pasaron por un punto quiescente (users_quiescent) posterior a
+// la publicación.
+#define USERS_INITIAL_BUCKETS 16
+/** cantidad máxima de hilos lectores (reactores) registrados */
+#define USERS_MAX_READERS 64
+
+/** segundos que vale una verificación exitosa en la caché */
+#define VERIFY_CACHE_TTL 30
+/** entradas de la caché (potencia de 2, mapeo directo por usuario) */
+#define VERIFY_CACHE_SIZE 1024
+
+struct verify_cache_entry {
+  uint8_t digest[SHA256_DIGEST_LEN];
+  time_t expires;
+};
+
+static struct verify_cache_entry verify_cache[VERIFY_CACHE_SIZE];
+
+/**
+ * Buckets de la tabla. El arreglo no cambia de tamaño una vez publicado: sus
+ * cabezas sí, de a una por cambio.
+ */
+struct users_table {
+  _Atomic(const user_t *) *buckets;
+  size_t nbuckets;
+};
+
+/** lo que dejó de ser alcanzable en una publicación */
+struct users_retired {
+  struct users_table *table; // tabla reemplazada, con todos sus nodos
+  user_t *nodes;             // nodos sueltos, enlazados por `retired_next'
+  userdb *db;                // base reemplazada
+  uint64_t epoch;
+  struct users_retired *next;
+};
+
+static const struct users_table empty_table = {0};
+static _Atomic(const struct users_table *) current = &empty_table;
+/** usuarios en la tabla (sin los de la base). Sólo lo cambian escritores */
+static atomic_size_t users_count = 0;
+/** base precompilada (-U), o NULL */
+static _Atomic(userdb *) current_db = NULL;
+
+// Época global: avanza en cada publicación. Cada lector anota la época que
+// vio en su último punto quiescente (0 = slot libre).
+static atomic_uint_fast64_t global_epoch = 1;
+static atomic_uint_fast64_t reader_epochs[USERS_MAX_READERS];
+
+// Serializa a los escritores y protege la lista de retirados
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct users_retired *retired = NULL;
+static atomic_bool retired_pending = false;
+
+// Ruta de la base (-U). Sólo la usan el arranque y el vigilante
+static char *db_path = NULL;
+static const char *db_file = NULL; // nombre dentro del directorio vigilado
+
+static unsigned user_hash(const char *username) {
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (const char *c = username; *c != '\0'; c++) {
+    h ^= (unsigned char)*c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static _Atomic(const user_t *) *users_bucket(const struct users_table *t,
+                                             unsigned hash) {
+  return &t->buckets[hash & (t->nbuckets - 1)];
+}
+
+// Retorna el nodo del usuario, o NULL si no existe
+static const user_t *users_find(const struct users_table *t,
+                                const char *username, unsigned hash) {
+  if (t->nbuckets == 0) {
+    return NULL;
+  }
+  for (const user_t *u = atomic_load(users_bucket(t, hash)); u != NULL;
+       u = u->next) {
+    if (u->hash == hash && strcmp(u->username, username) == 0) {
+      return u;
+    }
+  }
+  return NULL;
+}
+
+static user_t *user_node(const char *username, unsigned hash,
+                         const user_verifier *v, const user_t *next) {
+  size_t len = strlen(username);
+  user_t *u = malloc(sizeof(*u) + len + 1);
+  if (u == NULL) {
+    return NULL;
+  }
+  u->next = next;
+  u->retired_next = NULL;
+  u->verifier = *v;
+  u->hash = hash;
+  memcpy(u->username, username, len + 1);
+  return u;
+}
+
+static void users_chain_free(const user_t *u) {
+  while (u != NULL) {
+    const user_t *next = u->next;
+    free((void *)u);
+    u = next;
+  }
+}
+
+static void users_table_free(struct users_table *t) {
+  if (t != NULL && t != &empty_table) {
+    for (size_t i = 0; i < t->nbuckets; i++) {
+      users_chain_free(atomic_load(&t->buckets[i]));
+    }
+    free(t->buckets);
+    free(t);
+  }
+}
+
+// Copia `old' con el doble de buckets. Los nodos no pueden compartirse: su
+// `next' cambia con el bucket
+static struct users_table *users_grow(const struct users_table *old) {
+  struct users_table *t = malloc(sizeof(*t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->nbuckets = old->nbuckets == 0 ? USERS_INITIAL_BUCKETS : old->nbuckets * 2;
+  t->buckets = calloc(t->nbuckets, sizeof(*t->buckets));
+  if (t->buckets == NULL) {
+    free(t);
+    return NULL;
+  }
+  for (size_t i = 0; i < old->nbuckets; i++) {
+    for (const user_t *u = atomic_load(&old->buckets[i]); u != NULL;
+         u = u->next) {
+      _Atomic(const user_t *) *head = users_bucket(t, u->hash);
+      user_t *copy =
+          user_node(u->username, u->hash, &u->verifier, atomic_load(head));
+      if (copy == NULL) {
+        users_table_free(t);
+        return NULL;
+      }
+      atomic_store(head, copy);
+    }
+  }
+  return t;
+}
+
+// Libera lo retirado que ya ningún lector puede estar mirando. Requiere
+// writer_mutex.
+static void users_reclaim(void) {
+  uint64_t min = UINT64_MAX;
+  for (int i = 0; i < USERS_MAX_READERS; i++) {
+    uint64_t e = atomic_load(&reader_epochs[i]);
+    if (e != 0 && e < min) {
+      min = e;
+    }
+  }
+
+  struct users_retired **p = &retired;
+  while (*p != NULL) {
+    struct users_retired *r = *p;
+    if (r->epoch > min) {
+      p = &r->next;
+      continue;
+    }
+    *p = r->next;
+    users_table_free(r->table);
+    while (r->nodes != NULL) {
+      user_t *next = r->nodes->retired_next;
+      free(r->nodes);
+      r->nodes = next;
+    }
+    userdb_close(r->db);
+    free(r);
+  }
+  atomic_store(&retired_pending, retired != NULL);
+}
+
+// Retira lo que dejó de ser alcanzable con la publicación que se acaba de
+// hacer. `r' se reserva antes de publicar, así esto no puede fallar. Requiere
+// writer_mutex.
+static void users_retire(struct users_retired *r) {
+  // un lector que vea esta época (o una posterior) ya no ve lo retirado
+  r->epoch = atomic_fetch_add(&global_epoch, 1) + 1;
+  r->next = retired;
+  retired = r;
+
+  users_reclaim();
+}
+
+int users_reader_register(void) {
+  for (int i = 0; i < USERS_MAX_READERS; i++) {
+    uint_fast64_t expected = 0;
+    if (atomic_compare_exchange_strong(&reader_epochs[i], &expected,
+                                       atomic_load(&global_epoch))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void users_reader_unregister(int reader) {
+  if (reader < 0 || reader >= USERS_MAX_READERS) {
+    return;
+  }
+  atomic_store(&reader_epochs[reader], 0);
+}
+
+void users_quiescent(int reader) {
+  if (reader < 0 || reader >= USERS_MAX_READERS) {
+    return;
+  }
+  atomic_store(&reader_epochs[reader], atomic_load(&global_epoch));
+
+  // un lector nunca espera: si hay un escritor, él se encarga de liberar
+  if (atomic_load(&retired_pending) &&
+      pthread_mutex_trylock(&writer_mutex) == 0) {
+    users_reclaim();
+    pthread_mutex_unlock(&writer_mutex);
+  }
+}
+
+static bool random_bytes(uint8_t *out, size_t len) {
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd < 0)
+    return false;
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, out + done, len - done);
+    if (n <= 0) {
+      close(fd);
+      return false;
+    }
+    done += n;
+  }
+  close(fd);
+  return true;
+}
 
-static user_t users[MAX_USERS];
-static int user_count = 0;
+// Compara sin cortar en el primer byte distinto
+static bool equal_ct(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
 
 bool init_users(void) {
-  user_count = 0;
   const char *admin = getenv("ADMIN");
   char *username, *password;
   if (admin) {
@@ -53,82 +316,335 @@ void parse_user(const char *user, char **username, char **password) {
   (*password)[password_length] = '\0';
 }
 
+bool new_verifier(const char *password, user_verifier *v) {
+  v->iterations = USER_KDF_ITERATIONS;
+  if (!random_bytes(v->salt, sizeof(v->salt)))
+    return false;
+  pbkdf2_sha256((const uint8_t *)password, strlen(password), v->salt,
+                sizeof(v->salt), v->iterations, v->key, sizeof(v->key));
+  return true;
+}
+
 bool add_user(const char *username, const char *password) {
   if (!username || !password)
     return false;
 
-  for (int i = 0; i < user_count; i++) {
-    if (users[i].is_active && strcmp(users[i].username, username) == 0) {
+  // el KDF corre fuera del lock: es lo caro de dar de alta
+  user_verifier v;
+  if (!new_verifier(password, &v))
+    return false;
+  return add_user_verifier(username, &v);
+}
 
-      return false;
-    }
-  }
+bool add_user_verifier(const char *username, const user_verifier *v) {
+  if (!username)
+    return false;
 
-  for (int i = 0; i < user_count; i++) {
-    if (!users[i].is_active) {
-      users[i].username = strdup(username);
-      users[i].password = strdup(password);
-      users[i].is_active = true;
-      return true;
+  bool ret = false;
+  unsigned hash = user_hash(username);
+  pthread_mutex_lock(&writer_mutex);
+  const struct users_table *t = atomic_load(&current);
+  user_verifier existing;
+  if (users_find(t, username, hash) != NULL ||
+      userdb_lookup(atomic_load(&current_db), username, &existing))
+    goto finally;
+
+  if (atomic_load(&users_count) + 1 > t->nbuckets) {
+    struct users_retired *r = calloc(1, sizeof(*r));
+    struct users_table *bigger = r == NULL ? NULL : users_grow(t);
+    if (bigger == NULL) {
+      free(r);
+      goto finally;
     }
+    atomic_store(&current, bigger);
+    r->table = (struct users_table *)t;
+    users_retire(r);
+    t = bigger;
   }
 
-  if (user_count >= MAX_USERS)
-    return false;
-
-  users[user_count].username = strdup(username);
-  users[user_count].password = strdup(password);
-  users[user_count].is_active = true;
-  user_count++;
-  return true;
+  // el nodo nuevo va al frente: la cadena que sigue no cambia
+  _Atomic(const user_t *) *head = users_bucket(t, hash);
+  user_t *u = user_node(username, hash, v, atomic_load(head));
+  if (u == NULL)
+    goto finally;
+  atomic_store(head, u);
+  atomic_fetch_add(&users_count, 1);
+  ret = true;
+
+finally:
+  pthread_mutex_unlock(&writer_mutex);
+  return ret;
 }
 
 bool del_user(char *username) {
   if (!username)
     return false;
 
-  for (int i = 0; i < user_count; i++) {
-    if (users[i].is_active && strcmp(users[i].username, username) == 0) {
-      users[i].is_active = false;
-      free(users[i].username);
-      free(users[i].password);
-      return true;
+  bool ret = false;
+  unsigned hash = user_hash(username);
+  pthread_mutex_lock(&writer_mutex);
+  const struct users_table *t = atomic_load(&current);
+  const user_t *u = users_find(t, username, hash);
+  if (u == NULL)
+    goto finally;
+
+  struct users_retired *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    goto finally;
+
+  // Los nodos anteriores a `u' se copian y la copia se enlaza con lo que le
+  // sigue, que se comparte
+  _Atomic(const user_t *) *head = users_bucket(t, hash);
+  const user_t *first = atomic_load(head);
+  const user_t *chain = u->next;
+  user_t *last = NULL;
+  for (const user_t *p = first; p != u; p = p->next) {
+    user_t *copy = user_node(p->username, p->hash, &p->verifier, NULL);
+    if (copy == NULL) {
+      if (last != NULL) {
+        last->next = NULL;
+        users_chain_free(chain);
+      }
+      free(r);
+      goto finally;
     }
+    if (last == NULL) {
+      chain = copy;
+    } else {
+      last->next = copy;
+    }
+    last = copy;
+  }
+  if (last != NULL) {
+    last->next = u->next;
   }
+  atomic_store(head, chain);
+  atomic_fetch_sub(&users_count, 1);
+
+  // se retiran los originales reemplazados y el borrado
+  for (const user_t *p = first;; p = p->next) {
+    user_t *gone = (user_t *)p;
+    gone->retired_next = r->nodes;
+    r->nodes = gone;
+    if (p == u)
+      break;
+  }
+  users_retire(r);
+  ret = true;
 
-  return false;
+finally:
+  pthread_mutex_unlock(&writer_mutex);
+  return ret;
 }
 
-char *list_users() {
-  static char buf[4096];
-  int pos = 0;
-  buf[0] = '\0';
+char *list_users(void) {
+  const struct users_table *t = atomic_load(&current);
+  const userdb *db = atomic_load(&current_db);
+  size_t ndb = userdb_count(db);
 
-  for (int i = 0; i < user_count; i++) {
-    if (users[i].is_active) {
-      int written =
-          snprintf(buf + pos, sizeof(buf) - pos, "%s \n", users[i].username);
-      if (written < 0 || written >= (int)(sizeof(buf) - pos)) {
-        break;
-      }
-      pos += written;
+  size_t size = 1, pos = 0;
+  for (size_t i = 0; i < t->nbuckets; i++) {
+    for (const user_t *u = atomic_load(&t->buckets[i]); u != NULL;
+         u = u->next) {
+      size += strlen(u->username) + 2;
     }
   }
+  for (size_t i = 0; i < ndb; i++) {
+    const char *name = userdb_name(db, i);
+    size += name == NULL ? 0 : strlen(name) + 2;
+  }
+  char *out = malloc(size);
+  if (out == NULL)
+    return NULL;
+  out[0] = '\0';
+
+  // Formato: usuario\r\n. Un alta concurrente desde otro hilo puede no
+  // entrar: queda para el próximo listado
+  for (size_t i = 0; i < t->nbuckets; i++) {
+    for (const user_t *u = atomic_load(&t->buckets[i]); u != NULL;
+         u = u->next) {
+      size_t len = strlen(u->username);
+      if (pos + len + 2 >= size)
+        return out;
+      pos += snprintf(out + pos, size - pos, "%s\r\n", u->username);
+    }
+  }
+  // los de la base, salvo los que la tabla redefine
+  for (size_t i = 0; i < ndb; i++) {
+    const char *name = userdb_name(db, i);
+    if (name == NULL || users_find(t, name, user_hash(name)) != NULL)
+      continue;
+    pos += snprintf(out + pos, size - pos, "%s\r\n", name);
+  }
+  return out;
+}
 
-  return buf;
+bool get_user_verifier(const char *username, user_verifier *v) {
+  if (!username)
+    return false;
+
+  const struct users_table *t = atomic_load(&current);
+  const user_t *u = users_find(t, username, user_hash(username));
+  if (u == NULL)
+    return userdb_lookup(atomic_load(&current_db), username, v);
+  *v = u->verifier;
+  return true;
 }
 
-bool check_credentials(const char *username, const char *password) {
-  if (!username || !password)
+bool verify_password(const user_verifier *v, const char *password) {
+  uint8_t key[USER_KEY_LEN];
+  pbkdf2_sha256((const uint8_t *)password, strlen(password), v->salt,
+                sizeof(v->salt), v->iterations, key, sizeof(key));
+  return equal_ct(key, v->key, sizeof(key));
+}
+
+bool same_verifier(const user_verifier *a, const user_verifier *b) {
+  return a->iterations == b->iterations &&
+         memcmp(a->salt, b->salt, sizeof(a->salt)) == 0 &&
+         memcmp(a->key, b->key, sizeof(a->key)) == 0;
+}
+
+// Digest rápido que identifica el par (usuario, contraseña). Incluye el
+// verificador entero, así un cambio de contraseña invalida las entradas viejas.
+static void credentials_digest(const char *username, const user_verifier *v,
+                               const char *password,
+                               uint8_t out[SHA256_DIGEST_LEN]) {
+  struct sha256_ctx ctx;
+  sha256_init(&ctx);
+  sha256_update(&ctx, v->salt, sizeof(v->salt));
+  sha256_update(&ctx, v->key, sizeof(v->key));
+  sha256_update(&ctx, &v->iterations, sizeof(v->iterations));
+  sha256_update(&ctx, username, strlen(username) + 1);
+  sha256_update(&ctx, password, strlen(password));
+  sha256_final(&ctx, out);
+}
+
+static time_t monotonic_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+bool cached_credentials(const char *username, const user_verifier *v,
+                        const char *password) {
+  struct verify_cache_entry *e =
+      &verify_cache[user_hash(username) & (VERIFY_CACHE_SIZE - 1)];
+  if (e->expires <= monotonic_now())
     return false;
 
-  for (int i = 0; i < user_count; i++) {
-    if (users[i].is_active && strcmp(users[i].username, username) == 0 &&
-        strcmp(users[i].password, password) == 0) {
-      return true;
+  uint8_t digest[SHA256_DIGEST_LEN];
+  credentials_digest(username, v, password, digest);
+  return equal_ct(digest, e->digest, sizeof(digest));
+}
+
+void cache_credentials(const char *username, const user_verifier *v,
+                       const char *password) {
+  struct verify_cache_entry *e =
+      &verify_cache[user_hash(username) & (VERIFY_CACHE_SIZE - 1)];
+  credentials_digest(username, v, password, e->digest);
+  e->expires = monotonic_now() + VERIFY_CACHE_TTL;
+}
+
+// Publica `fresh' como base precompilada y retira la anterior
+static bool users_swap_db(userdb *fresh) {
+  struct users_retired *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return false;
+  pthread_mutex_lock(&writer_mutex);
+  r->db = atomic_exchange(&current_db, fresh);
+  users_retire(r);
+  pthread_mutex_unlock(&writer_mutex);
+  return true;
+}
+
+bool load_user_db(const char *path) {
+  char *copy = strdup(path);
+  if (copy == NULL)
+    return false;
+  userdb *fresh = userdb_open(path);
+  if (fresh == NULL || !users_swap_db(fresh)) {
+    userdb_close(fresh);
+    free(copy);
+    return false;
+  }
+  free(db_path);
+  db_path = copy;
+  const char *slash = strrchr(db_path, '/');
+  db_file = slash == NULL ? db_path : slash + 1;
+  printf("Loaded %zu users from %s\n", userdb_count(fresh), db_path);
+  return true;
+}
+
+static void reload_user_db(void) {
+  // la base vieja queda cargada hasta que ningún lector pueda estar usándola
+  userdb *fresh = userdb_open(db_path);
+  if (fresh == NULL || !users_swap_db(fresh)) {
+    userdb_close(fresh);
+    fprintf(stderr, "Keeping previous user database\n");
+    return;
+  }
+  printf("Reloaded %zu users from %s\n", userdb_count(fresh), db_path);
+}
+
+static void db_watch_read(struct selector_key *key) {
+  _Alignas(struct inotify_event) char buf[4096];
+  bool changed = false;
+  ssize_t n;
+
+  // drenamos todo lo pendiente: varias escrituras seguidas valen una recarga
+  while ((n = read(key->fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      if (ev->len > 0 && strcmp(ev->name, db_file) == 0)
+        changed = true;
+      p += sizeof(*ev) + ev->len;
     }
   }
-  return false;
+  if (changed)
+    reload_user_db();
+}
+
+static void db_watch_close(struct selector_key *key) { close(key->fd); }
+
+bool watch_user_db(fd_selector s) {
+  static const struct fd_handler handler = {
+      .handle_read = db_watch_read,
+      .handle_close = db_watch_close,
+  };
+  if (db_path == NULL)
+    return true;
+
+  // se vigila el directorio y no el archivo: mkuserdb reemplaza la base con
+  // rename(2), que deja al inode original fuera de la vigilancia
+  char dir[4096];
+  size_t dir_len = db_file - db_path;
+  if (dir_len == 0) {
+    strcpy(dir, ".");
+  } else if (dir_len < sizeof(dir)) {
+    memcpy(dir, db_path, dir_len);
+    dir[dir_len] = '\0';
+  } else {
+    return false;
+  }
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return false;
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+      selector_register(s, fd, &handler, OP_READ, NULL) != SELECTOR_SUCCESS) {
+    close(fd);
+    return false;
+  }
+  return true;
+}
+
+// Recortar el argumento cambiaría el usuario, host o valor afectado
+static bool copy_arg(char *arg, const char *value) {
+  size_t len = strlen(value);
+  if (len >= ARG_SIZE)
+    return false;
+  memcpy(arg, value, len + 1);
+  return true;
 }
 
 mng_cmd parse_command(const char *line, char *arg) {
@@ -149,8 +665,7 @@ mng_cmd parse_command(const char *line, char *arg) {
     char *cred = strtok_r(NULL, " \r\n", &saveptr);
     if (!cred)
       return UNKNOWN;
-    strncpy(arg, cred, 127);
-    return AUTH;
+    return copy_arg(arg, cred) ? AUTH : ARG_TOO_LONG;
   }
 
   if (strcasecmp(cmd, "METRICS") == 0)
@@ -160,16 +675,14 @@ mng_cmd parse_command(const char *line, char *arg) {
     char *cred = strtok_r(NULL, " \r\n", &saveptr);
     if (!cred)
       return UNKNOWN;
-    strncpy(arg, cred, 127);
-    return ADD_USER;
+    return copy_arg(arg, cred) ? ADD_USER : ARG_TOO_LONG;
   }
 
   if (strcasecmp(cmd, "DEL_USER") == 0) {
     char *username = strtok_r(NULL, " \r\n", &saveptr);
     if (!username)
       return UNKNOWN;
-    strncpy(arg, username, 127);
-    return DEL_USER;
+    return copy_arg(arg, username) ? DEL_USER : ARG_TOO_LONG;
   }
 
   if (strcasecmp(cmd, "LIST_USERS") == 0)
@@ -182,10 +695,87 @@ mng_cmd parse_command(const char *line, char *arg) {
     char *size = strtok_r(NULL, " \r\n", &saveptr);
     if (!size)
       return UNKNOWN;
-    strncpy(arg, size, 127);
-    return SET_BUFFER;
+    return copy_arg(arg, size) ? SET_BUFFER : ARG_TOO_LONG;
+  }
+
+  if (strcasecmp(cmd, "ADD_HOST") == 0) {
+    char *entry = strtok_r(NULL, " \r\n", &saveptr);
+    if (!entry)
+      return UNKNOWN;
+    return copy_arg(arg, entry) ? ADD_HOST : ARG_TOO_LONG;
+  }
+
+  if (strcasecmp(cmd, "DEL_HOST") == 0) {
+    char *host = strtok_r(NULL, " \r\n", &saveptr);
+    if (!host)
+      return UNKNOWN;
+    return copy_arg(arg, host) ? DEL_HOST : ARG_TOO_LONG;
+  }
+
+  if (strcasecmp(cmd, "LIST_HOSTS") == 0)
+    return LIST_HOSTS;
+
+  if (strcasecmp(cmd, "SET_LIMIT") == 0) {
+    char *limit = strtok_r(NULL, " \r\n", &saveptr);
+    if (!limit)
+      return UNKNOWN;
+    return copy_arg(arg, limit) ? SET_LIMIT : ARG_TOO_LONG;
   }
 
+  if (strcasecmp(cmd, "LIST_LIMITS") == 0)
+    return LIST_LIMITS;
+
+  if (strcasecmp(cmd, "SET_CAPACITY") == 0) {
+    char *capacity = strtok_r(NULL, " \r\n", &saveptr);
+    if (!capacity)
+      return UNKNOWN;
+    return copy_arg(arg, capacity) ? SET_CAPACITY : ARG_TOO_LONG;
+  }
+
+  if (strcasecmp(cmd, "SET_SOCKOPT") == 0) {
+    char *opt = strtok_r(NULL, " \r\n", &saveptr);
+    if (!opt)
+      return UNKNOWN;
+    return copy_arg(arg, opt) ? SET_SOCKOPT : ARG_TOO_LONG;
+  }
+
+  if (strcasecmp(cmd, "LIST_SOCKOPTS") == 0)
+    return LIST_SOCKOPTS;
+
+  if (strcasecmp(cmd, "METRICS_HISTORY") == 0) {
+    char *window = strtok_r(NULL, " \r\n", &saveptr);
+    if (!window)
+      return UNKNOWN;
+    return copy_arg(arg, window) ? METRICS_HISTORY : ARG_TOO_LONG;
+  }
+
+  // Los filtros son opcionales y van todos juntos
+  if (strcasecmp(cmd, "LIST_SESSIONS") == 0) {
+    char *filters = strtok_r(NULL, "\r\n", &saveptr);
+    if (filters && !copy_arg(arg, filters))
+      return ARG_TOO_LONG;
+    return LIST_SESSIONS;
+  }
+
+  if (strcasecmp(cmd, "KILL_SESSION") == 0) {
+    char *id = strtok_r(NULL, " \r\n", &saveptr);
+    if (!id)
+      return UNKNOWN;
+    return copy_arg(arg, id) ? KILL_SESSION : ARG_TOO_LONG;
+  }
+
+  // La cantidad es opcional
+  if (strcasecmp(cmd, "TOP_DESTINATIONS") == 0 ||
+      strcasecmp(cmd, "TOP_USERS") == 0) {
+    char *count = strtok_r(NULL, " \r\n", &saveptr);
+    if (count && !copy_arg(arg, count))
+      return ARG_TOO_LONG;
+    return strcasecmp(cmd, "TOP_USERS") == 0 ? TOP_USERS : TOP_DESTINATIONS;
+  }
+
+  if (strcasecmp(cmd, "UNIQUES") == 0)
+    return UNIQUES;
+
   if (strcasecmp(cmd, "QUIT") == 0)
     return QUIT;
 
@@ -1,20 +1,114 @@
 #ifndef MNG_USERS_H
 #define MNG_USERS_H
+#include "lib/selector.h"
 #include "metrics.h"
 #include <stdbool.h>
+#include <stdint.h>
 
+#define USER_SALT_LEN 16
+#define USER_KEY_LEN 32
+/** iteraciones de PBKDF2-HMAC-SHA256 para las contraseñas nuevas */
+#define USER_KDF_ITERATIONS 10000
+
+/**
+ * Lo necesario para verificar una contraseña: nunca se guarda en claro, sólo
+ * la clave derivada con PBKDF2 y su salt.
+ */
+typedef struct {
+  uint8_t salt[USER_SALT_LEN];
+  uint8_t key[USER_KEY_LEN];
+  uint32_t iterations;
+} user_verifier;
+
+/** usuario en la cadena de su bucket. Inmutable una vez publicado */
 typedef struct user {
-  char *username;
-  char *password;
-  bool is_active;
+  const struct user *next;   // siguiente en la cadena
+  struct user *retired_next; // siguiente en la lista de retirados
+  user_verifier verifier;
+  unsigned hash;
+  char username[];
 } user_t;
 
 bool init_users(void);
+
+/**
+ * Las consultas de usuarios nunca bloquean. Un alta o una baja publica sólo
+ * la cadena del bucket afectado, en O(1) esperado; cuando la tabla se
+ * duplica el alta la copia entera, O(1) amortizado. Una recarga de la base
+ * sólo publica el puntero a ella. Cada hilo que consulta usuarios (un
+ * reactor) se registra y llama a users_quiescent() cuando no retiene nada
+ * leído de la tabla, típicamente entre vueltas del selector: lo reemplazado
+ * se libera cuando todos los registrados pasaron por ese punto.
+ *
+ * users_reader_register retorna el id del lector, o -1 si no hay lugar.
+ */
+int users_reader_register(void);
+void users_reader_unregister(int reader);
+void users_quiescent(int reader);
+
 void parse_user(const char *user, char **username, char **password);
+/**
+ * Da de alta `username'. Corre el KDF en el hilo que llama: desde el hilo del
+ * selector usar el derivado diferido (ver socks5/auth_verify.h) y
+ * add_user_verifier.
+ */
 bool add_user(const char *username, const char *password);
+/** da de alta `username' con un verificador ya derivado */
+bool add_user_verifier(const char *username, const user_verifier *v);
 bool del_user(char *username);
+/**
+ * Una línea por usuario, de la tabla y de la base. El caller libera el
+ * string; NULL si no hay memoria.
+ */
 char *list_users(void);
-bool check_credentials(const char *username, const char *password);
+
+/** copia el verificador de `username'. Retorna false si no existe */
+bool get_user_verifier(const char *username, user_verifier *v);
+
+/** corre el KDF y compara. Es costosa pero puede llamarse desde otro hilo */
+bool verify_password(const user_verifier *v, const char *password);
+
+/**
+ * Deriva un verificador para `password' con una salt al azar. Corre el KDF:
+ * es costosa pero puede llamarse desde otro hilo. Retorna false sin entropía.
+ */
+bool new_verifier(const char *password, user_verifier *v);
+
+/** indica si los dos verificadores son el mismo (salt, clave e iteraciones) */
+bool same_verifier(const user_verifier *a, const user_verifier *b);
+
+/**
+ * Caché de verificaciones exitosas recientes, indexada por (usuario, digest de
+ * la contraseña con la salt del usuario). Evita repetir el KDF para clientes
+ * que reconectan seguido. Sólo desde el hilo del selector.
+ */
+bool cached_credentials(const char *username, const user_verifier *v,
+                        const char *password);
+void cache_credentials(const char *username, const user_verifier *v,
+                       const char *password);
+
+/**
+ * Carga la base de usuarios precompilada (ver userdb.h). Sus usuarios se
+ * suman a los de la tabla en memoria, que tiene prioridad; no pueden borrarse
+ * ni redefinirse desde management.
+ */
+bool load_user_db(const char *path);
+
+/**
+ * Vigila con inotify el directorio de la base cargada y la vuelve a cargar
+ * cuando el archivo se reemplaza (rename o close después de escribir). Si la
+ * base nueva no valida se sigue usando la anterior. Las sesiones en curso no
+ * se ven afectadas porque trabajan con copias del verificador.
+ */
+bool watch_user_db(fd_selector s);
+
+/** tamaño de `arg' en parse_command, con el terminador */
+#define ARG_SIZE 128
+
+/**
+ * Identifica el comando de `line' y copia su argumento en `arg'. Un argumento
+ * que no entra no se recorta: retorna ARG_TOO_LONG.
+ */
 mng_cmd parse_command(const char *line, char *arg);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "statspage.h"
+
+_Static_assert(STATSPAGE_ENTRIES >= METRICS_MAX,
+               "la página tiene que alcanzar para todas las métricas");
+
+static struct statspage *page = NULL;
+static char *page_path = NULL;
+
+static uint64_t realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Los nombres sólo cambian al registrarse una métrica nueva: en régimen la
+// escritura es una pasada de stores relajados entre los dos incrementos
+static void publish(void) {
+  uint64_t seq = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+  atomic_store_explicit(&page->sequence, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  unsigned n = metrics_count();
+  for (unsigned i = page->count; i < n; i++) {
+    struct statspage_entry *e = &page->entries[i];
+    strncpy(e->name, metrics_name(i), sizeof(e->name) - 1);
+    e->kind = metrics_is_gauge(i) ? STATSPAGE_GAUGE : STATSPAGE_COUNTER;
+  }
+  page->count = n;
+  for (unsigned i = 0; i < n; i++) {
+    atomic_store_explicit(&page->entries[i].value, metrics_value(i),
+                          memory_order_relaxed);
+  }
+  page->updated_at = realtime_ns();
+
+  atomic_store_explicit(&page->sequence, seq + 2, memory_order_release);
+}
+
+static void publish_tick(fd_selector s, void *data) {
+  (void)data;
+  if (page == NULL) {
+    return;
+  }
+  publish();
+  selector_timer_add(s, STATSPAGE_INTERVAL_MS, publish_tick, NULL);
+}
+
+bool statspage_open(fd_selector s, const char *path) {
+  bool ret = false;
+  void *map = MAP_FAILED;
+  int fd = -1;
+  // En un directorio compartido como /dev/shm alguien pudo dejar un symlink
+  // con el nombre de la página: se borra lo que haya (si es un symlink, el
+  // link y no su destino) y se crea un archivo nuevo que no puede ser otro
+  if (unlink(path) != 0 && errno != ENOENT) {
+    goto finally;
+  }
+  fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    goto finally;
+  }
+  page_path = strdup(path);
+  if (page_path == NULL) {
+    goto finally;
+  }
+  if (ftruncate(fd, sizeof(struct statspage)) != 0) {
+    goto finally;
+  }
+  map = mmap(NULL, sizeof(struct statspage), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    goto finally;
+  }
+  page = map;
+  page->version = STATSPAGE_VERSION;
+  page->entry_size = sizeof(struct statspage_entry);
+  page->pid = getpid();
+  page->interval_ms = STATSPAGE_INTERVAL_MS;
+  page->started_at = realtime_ns();
+  publish();
+  // el magic al final: un lector no acepta una página a medio armar
+  memcpy(page->magic, STATSPAGE_MAGIC, sizeof(page->magic));
+
+  ret = selector_timer_add(s, STATSPAGE_INTERVAL_MS, publish_tick, NULL) != 0;
+
+finally:
+  if (!ret) {
+    int error = errno; // lo informa el caller
+    if (map != MAP_FAILED) {
+      munmap(map, sizeof(struct statspage));
+      page = NULL;
+    }
+    if (fd >= 0) {
+      unlink(path);
+    }
+    free(page_path);
+    page_path = NULL;
+    errno = error;
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ret;
+}
+
+void statspage_close(void) {
+  if (page != NULL) {
+    munmap(page, sizeof(struct statspage));
+    page = NULL;
+    unlink(page_path);
+    free(page_path);
+    page_path = NULL;
+  }
+}
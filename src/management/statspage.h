@@ -0,0 +1,68 @@
+#ifndef STATSPAGE_H
+#define STATSPAGE_H
+
+#include "lib/selector.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * statspage.c - métricas publicadas en un archivo mapeado en memoria
+ *
+ * El servidor copia periódicamente los valores de todas las métricas a una
+ * página en /dev/shm. Un agente local la mapea y la lee cuando quiere, sin
+ * pasar por el protocolo de management ni por el loop de eventos (ver
+ * `socks5stat').
+ *
+ * La página se protege con un seqlock: el servidor pone `sequence' en impar,
+ * escribe y la vuelve a par. El lector toma `sequence' (si es impar
+ * reintenta), copia lo que necesita y vuelve a leer `sequence': si cambió la
+ * copia puede estar mezclada y se reintenta. El servidor nunca espera a los
+ * lectores. Todos los enteros están en el orden de bytes de la máquina.
+ */
+#define STATSPAGE_MAGIC "S5STATS"
+#define STATSPAGE_VERSION 1
+#define STATSPAGE_NAME_MAX 48
+#define STATSPAGE_ENTRIES 64
+/** cada cuánto se publica */
+#define STATSPAGE_INTERVAL_MS 50
+
+enum statspage_kind {
+  STATSPAGE_COUNTER,
+  STATSPAGE_GAUGE,
+};
+
+struct statspage_entry {
+  char name[STATSPAGE_NAME_MAX]; // terminado en '\0'
+  uint32_t kind;                 // enum statspage_kind
+  uint32_t reserved;
+  _Atomic uint64_t value;
+};
+
+struct statspage {
+  // fijos desde que se crea la página
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size; // sizeof(struct statspage_entry)
+  uint32_t pid;
+  uint32_t interval_ms;
+  uint64_t started_at; // CLOCK_REALTIME en nanosegundos
+
+  // protegidos por el seqlock
+  _Atomic uint64_t sequence;
+  uint64_t updated_at; // CLOCK_REALTIME en nanosegundos
+  uint32_t count;      // entradas válidas
+  uint32_t reserved;
+  struct statspage_entry entries[STATSPAGE_ENTRIES];
+};
+
+/**
+ * Crea la página en `path' y programa su actualización. Retorna false ante
+ * error (detalle en errno); el servidor sigue sin ella.
+ */
+bool statspage_open(fd_selector s, const char *path);
+
+/** borra la página: un lector no confunde un servidor parado con uno quieto */
+void statspage_close(void);
+
+#endif
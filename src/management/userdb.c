@@ -0,0 +1,314 @@
+#include "userdb.h"
+#include "lib/sha256.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct userdb {
+  uint8_t *data;
+  size_t size;
+
+  const struct userdb_header *header;
+  const uint32_t *slots;
+  const struct userdb_record *records;
+  const char *names;
+};
+
+// FNV-1a: es parte del formato, no cambiar sin subir USERDB_VERSION
+static uint32_t name_hash(const char *name, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// verifica que [offset, offset + len) esté dentro del archivo
+static bool in_bounds(uint64_t offset, uint64_t len, size_t size) {
+  return offset <= size && len <= size - offset;
+}
+
+userdb *userdb_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "userdb: %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct userdb_header)) {
+    fprintf(stderr, "userdb: %s: file too small\n", path);
+    close(fd);
+    return NULL;
+  }
+  // Se copia en vez de mapearse: si alguien reescribe o trunca el archivo en
+  // el lugar, un mapeo daría SIGBUS al leer las páginas que ya no existen
+  size_t size = st.st_size;
+  uint8_t *data = malloc(size);
+  if (data == NULL) {
+    fprintf(stderr, "userdb: %s: out of memory\n", path);
+    close(fd);
+    return NULL;
+  }
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, data + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      fprintf(stderr, "userdb: %s: %s\n", path,
+              n < 0 ? strerror(errno) : "file changed while reading");
+      free(data);
+      close(fd);
+      return NULL;
+    }
+    done += n;
+  }
+  close(fd);
+
+  const struct userdb_header *h = (const struct userdb_header *)data;
+  const char *error = NULL;
+  if (memcmp(h->magic, USERDB_MAGIC, sizeof(h->magic)) != 0) {
+    error = "bad magic";
+  } else if (h->version != USERDB_VERSION) {
+    error = "unsupported version";
+  } else if (h->slot_count == 0 || (h->slot_count & (h->slot_count - 1)) ||
+             h->user_count >= h->slot_count) {
+    error = "bad index size";
+  } else if (!in_bounds(h->slots_offset,
+                        (uint64_t)h->slot_count * sizeof(uint32_t), size) ||
+             !in_bounds(h->records_offset,
+                        (uint64_t)h->user_count * sizeof(struct userdb_record),
+                        size) ||
+             !in_bounds(h->names_offset, h->names_size, size) ||
+             h->slots_offset % sizeof(uint32_t) != 0 ||
+             h->records_offset % sizeof(uint32_t) != 0) {
+    error = "truncated file";
+  }
+  if (error != NULL) {
+    fprintf(stderr, "userdb: %s: %s\n", path, error);
+    free(data);
+    return NULL;
+  }
+
+  userdb *db = malloc(sizeof(*db));
+  if (db == NULL) {
+    free(data);
+    return NULL;
+  }
+  db->data = data;
+  db->size = size;
+  db->header = h;
+  db->slots = (const uint32_t *)(db->data + h->slots_offset);
+  db->records = (const struct userdb_record *)(db->data + h->records_offset);
+  db->names = (const char *)(db->data + h->names_offset);
+  return db;
+}
+
+void userdb_close(userdb *db) {
+  if (db == NULL) {
+    return;
+  }
+  free(db->data);
+  free(db);
+}
+
+size_t userdb_count(const userdb *db) {
+  return db == NULL ? 0 : db->header->user_count;
+}
+
+const char *userdb_name(const userdb *db, size_t i) {
+  const struct userdb_record *r = db->records + i;
+  if (!in_bounds(r->name_offset, (uint64_t)r->name_len + 1,
+                 db->header->names_size) ||
+      db->names[r->name_offset + r->name_len] != '\0') {
+    return NULL;
+  }
+  return db->names + r->name_offset;
+}
+
+bool userdb_lookup(const userdb *db, const char *username, user_verifier *v) {
+  if (db == NULL || username == NULL) {
+    return false;
+  }
+  size_t len = strlen(username);
+  uint32_t hash = name_hash(username, len);
+  uint32_t mask = db->header->slot_count - 1;
+
+  // el índice siempre tiene slots vacíos, pero acotamos por si está dañado
+  for (uint32_t i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+    uint32_t slot = db->slots[i];
+    if (slot == 0) {
+      return false;
+    }
+    if (slot > db->header->user_count) {
+      return false;
+    }
+    const struct userdb_record *r = db->records + (slot - 1);
+    if (r->name_hash != hash || r->name_len != len ||
+        !in_bounds(r->name_offset, (uint64_t)len + 1, db->header->names_size)) {
+      continue;
+    }
+    if (memcmp(db->names + r->name_offset, username, len) == 0) {
+      // un registro dañado no puede dejar el KDF sin costo ni trabar el pool
+      if (r->iterations < USERDB_MIN_ITERATIONS ||
+          r->iterations > USERDB_MAX_ITERATIONS) {
+        return false;
+      }
+      memcpy(v->salt, r->salt, sizeof(v->salt));
+      memcpy(v->key, r->key, sizeof(v->key));
+      v->iterations = r->iterations;
+      return true;
+    }
+  }
+  return false;
+}
+
+long userdb_build(const char *in_path, const char *out_path,
+                  uint32_t iterations) {
+  FILE *in = fopen(in_path, "r");
+  if (in == NULL) {
+    fprintf(stderr, "userdb: %s: %s\n", in_path, strerror(errno));
+    return -1;
+  }
+  int urandom = open("/dev/urandom", O_RDONLY);
+  if (urandom < 0) {
+    fclose(in);
+    return -1;
+  }
+
+  struct userdb_record *records = NULL;
+  char *names = NULL;
+  size_t count = 0, records_cap = 0, names_size = 0, names_cap = 0;
+  long ret = -1;
+
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t n;
+  while ((n = getline(&line, &line_cap, in)) != -1) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+    char *sep = strchr(line, ':');
+    if (sep == NULL || sep == line) {
+      fprintf(stderr, "userdb: skipping malformed line: %s\n", line);
+      continue;
+    }
+    *sep = '\0';
+    const char *user = line, *pass = sep + 1;
+    size_t user_len = strlen(user);
+
+    if (count == records_cap) {
+      records_cap = records_cap == 0 ? 1024 : records_cap * 2;
+      void *tmp = realloc(records, records_cap * sizeof(*records));
+      if (tmp == NULL) {
+        goto finally;
+      }
+      records = tmp;
+    }
+    if (names_size + user_len + 1 > names_cap) {
+      names_cap = (names_cap == 0 ? 16384 : names_cap * 2) + user_len + 1;
+      void *tmp = realloc(names, names_cap);
+      if (tmp == NULL) {
+        goto finally;
+      }
+      names = tmp;
+    }
+
+    struct userdb_record *r = records + count;
+    memset(r, 0, sizeof(*r));
+    r->name_hash = name_hash(user, user_len);
+    r->name_offset = names_size;
+    r->name_len = user_len;
+    r->iterations = iterations;
+    if (read(urandom, r->salt, sizeof(r->salt)) != sizeof(r->salt)) {
+      goto finally;
+    }
+    pbkdf2_sha256((const uint8_t *)pass, strlen(pass), r->salt,
+                  sizeof(r->salt), iterations, r->key, sizeof(r->key));
+    memcpy(names + names_size, user, user_len + 1);
+    names_size += user_len + 1;
+    count++;
+  }
+
+  // índice con ocupación <= 1/2
+  uint32_t slot_count = 16;
+  while (slot_count < count * 2) {
+    slot_count *= 2;
+  }
+  uint32_t *slots = calloc(slot_count, sizeof(*slots));
+  if (slots == NULL) {
+    goto finally;
+  }
+  size_t written = 0;
+  for (size_t i = 0; i < count; i++) {
+    const char *user = names + records[i].name_offset;
+    uint32_t mask = slot_count - 1, j = records[i].name_hash & mask;
+    bool duplicate = false;
+    while (slots[j] != 0) {
+      const struct userdb_record *other = records + (slots[j] - 1);
+      if (other->name_hash == records[i].name_hash &&
+          strcmp(names + other->name_offset, user) == 0) {
+        duplicate = true;
+        break;
+      }
+      j = (j + 1) & mask;
+    }
+    if (duplicate) {
+      fprintf(stderr, "userdb: duplicated user %s, keeping the first\n", user);
+      continue;
+    }
+    // compactamos los registros a medida que se indexan
+    records[written] = records[i];
+    slots[j] = written + 1;
+    written++;
+  }
+
+  struct userdb_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, USERDB_MAGIC, sizeof(header.magic));
+  header.version = USERDB_VERSION;
+  header.slot_count = slot_count;
+  header.user_count = written;
+  header.slots_offset = sizeof(header);
+  header.records_offset = header.slots_offset + slot_count * sizeof(*slots);
+  header.names_offset =
+      header.records_offset + written * sizeof(struct userdb_record);
+  header.names_size = names_size;
+
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", out_path);
+  FILE *out = fopen(tmp_path, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "userdb: %s: %s\n", tmp_path, strerror(errno));
+    free(slots);
+    goto finally;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(slots, sizeof(*slots), slot_count, out) == slot_count &&
+            fwrite(records, sizeof(*records), written, out) == written &&
+            fwrite(names, 1, names_size, out) == names_size;
+  ok = fflush(out) == 0 && fsync(fileno(out)) == 0 && ok;
+  ok = fclose(out) == 0 && ok;
+  free(slots);
+  if (!ok || rename(tmp_path, out_path) != 0) {
+    fprintf(stderr, "userdb: could not write %s\n", out_path);
+    unlink(tmp_path);
+    goto finally;
+  }
+  ret = written;
+
+finally:
+  free(line);
+  free(records);
+  free(names);
+  close(urandom);
+  fclose(in);
+  return ret;
+}
@@ -0,0 +1,80 @@
+#ifndef USERDB_H
+#define USERDB_H
+
+#include "mng_users.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * userdb.c - base de credenciales precompilada
+ *
+ * El archivo lo genera `mkuserdb' a partir de líneas `usuario:contraseña' y
+ * ya trae las claves derivadas y el índice armados, así que abrirlo es leerlo
+ * de una vez y validar el encabezado: no se deriva ninguna clave ni se arma
+ * ningún índice. Todos los enteros están en el orden de bytes de la máquina
+ * que lo generó.
+ *
+ * Layout:
+ *   - struct userdb_header
+ *   - índice: `slot_count' uint32_t (potencia de 2) con linear probing por
+ *     FNV-1a del username; cada slot guarda índice de registro + 1 (0 = vacío)
+ *   - `user_count' struct userdb_record
+ *   - nombres de usuario terminados en '\0'
+ */
+#define USERDB_MAGIC "S5USERDB"
+#define USERDB_VERSION 1
+
+/** rango de iteraciones aceptado: fuera de él el registro se ignora */
+#define USERDB_MIN_ITERATIONS 1
+#define USERDB_MAX_ITERATIONS 1000000
+
+struct userdb_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t user_count;
+  uint32_t reserved;
+  uint64_t slots_offset;
+  uint64_t records_offset;
+  uint64_t names_offset;
+  uint64_t names_size;
+};
+
+struct userdb_record {
+  uint32_t name_hash;
+  uint32_t name_offset; // relativo al comienzo de los nombres
+  uint32_t name_len;
+  uint32_t iterations;
+  uint8_t salt[USER_SALT_LEN];
+  uint8_t key[USER_KEY_LEN];
+};
+
+typedef struct userdb userdb;
+
+/** carga y valida la base. Retorna NULL ante error (detalle en stderr) */
+userdb *userdb_open(const char *path);
+
+/** libera la base. Tolera NULL */
+void userdb_close(userdb *db);
+
+/** busca `username' y copia su verificador. Retorna false si no existe */
+bool userdb_lookup(const userdb *db, const char *username, user_verifier *v);
+
+/** cantidad de usuarios de la base */
+size_t userdb_count(const userdb *db);
+
+/** nombre del usuario `i' (menor a userdb_count), o NULL si está dañado */
+const char *userdb_name(const userdb *db, size_t i);
+
+/**
+ * Genera una base en `out_path' a partir de un archivo de texto con una línea
+ * `usuario:contraseña' por usuario. Escribe en un temporal y lo renombra, así
+ * un servidor que vigila el archivo nunca ve una base a medio escribir.
+ *
+ * Retorna la cantidad de usuarios escritos, o -1 ante error.
+ */
+long userdb_build(const char *in_path, const char *out_path,
+                  uint32_t iterations);
+
+#endif
@@ -0,0 +1,51 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "management/userdb.h"
+
+// Genera la base de credenciales que el servidor carga con -U a partir de un
+// archivo de texto con una línea `usuario:contraseña' por usuario.
+static void usage(const char *progname) {
+  fprintf(stderr,
+          "Usage: %s [-i <iterations>] <users.txt> <users.db>\n"
+          "\n"
+          "   -i <iterations>  Iteraciones de PBKDF2 por usuario (default "
+          "%d).\n"
+          "\n",
+          progname, USER_KDF_ITERATIONS);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  long iterations = USER_KDF_ITERATIONS;
+  int c;
+  while ((c = getopt(argc, argv, "hi:")) != -1) {
+    switch (c) {
+    case 'i': {
+      char *end;
+      errno = 0;
+      iterations = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || errno == ERANGE || iterations < USERDB_MIN_ITERATIONS ||
+          iterations > USERDB_MAX_ITERATIONS) {
+        fprintf(stderr, "invalid iteration count: %s\n", optarg);
+        return 1;
+      }
+      break;
+    }
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2) {
+    usage(argv[0]);
+  }
+
+  long n = userdb_build(argv[optind], argv[optind + 1], iterations);
+  if (n < 0) {
+    return 1;
+  }
+  printf("%ld users written to %s\n", n, argv[optind + 1]);
+  return 0;
+}
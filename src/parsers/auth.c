@@ -14,7 +14,8 @@ void auth_parser_init(struct auth_parser *p) {
 enum auth_state auth_consume(buffer *b, struct auth_parser *p, bool *errored) {
     enum auth_state st = p->state;
     
-    while(buffer_can_read(b)) {
+    // al terminar no leemos más: lo que sigue es el pedido
+    while(buffer_can_read(b) && st != AUTH_DONE_STATE) {
         const uint8_t c = buffer_read(b);
 
         switch(st) {
@@ -13,7 +13,8 @@ void hello_parser_init(struct hello_parser *p) {
 enum hello_state hello_consume(buffer *b, struct hello_parser *p, bool *errored) {
     enum hello_state state = p->state;
     
-    while(buffer_can_read(b)) {
+    // al terminar no leemos más: lo que sigue es del próximo mensaje
+    while(buffer_can_read(b) && state != HELLO_DONE) {
         const uint8_t c = buffer_read(b);
         
         switch(state) {
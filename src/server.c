@@ -1,5 +1,8 @@
+#define _GNU_SOURCE // accept4, struct tcp_info
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +10,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "admission.h"
 #include "args.h"
 #include "lib/buffer.h"
 #include "lib/selector.h"
@@ -14,9 +18,17 @@
 #include "parsers/auth.h"
 #include "parsers/hello.h"
 #include "server.h"
+#include "socks5/dns.h"
+#include "socks5/sessions.h"
 #include "socks5/socks5.h"
+#include "socks5/sockopts.h"
+#include "socks5/trusted.h"
+#include "socks5/uniques.h"
 #include "stm.h"
 
+/** conexiones que se aceptan como máximo por evento del listener */
+#define ACCEPT_BUDGET 64
+
 static void on_client_read(struct selector_key *key);
 static void on_client_write(struct selector_key *key);
 static void on_client_close(struct selector_key *key);
@@ -34,6 +46,15 @@ void session_destroy(client_t *session) {
   if (session != NULL) {
     session->references--;
     if (session->references == 0) {
+      // Cancelamos la resolución pendiente antes de liberar el fd: la
+      // consulta deja de notificarlo y no vuelve a tocar la sesión
+      dns_query_cancel(session->dns_query, session->client_fd);
+      socks5_close(session);
+      auth_verify_release(session->auth_job);
+      accounts_release(session->account, &session->throttle);
+      sched_remove(&session->sched);
+      sessions_remove(session);
+      admission_session_closed(session->handshaking);
       if (session->client_fd >= 0) {
         end_connection();
         close(session->client_fd);
@@ -71,12 +92,11 @@ static client_t *session_new(int fd) {
   return session;
 }
 
-// Handler de LECTURA: El cliente nos mandó datos.
-static void on_client_read(struct selector_key *key) {
-  client_t *session = key->data;
-
-  unsigned state = stm_handler_read(&session->stm, key);
-
+// Después de cada evento: actualiza el registro y, si la sesión terminó,
+// desregistra los dos extremos
+static void session_step(struct selector_key *key, client_t *session,
+                         unsigned state) {
+  sessions_transition(session, state);
   if (state == ERROR || state == DONE) {
     int other_fd = (key->fd == session->client_fd) ? session->origin_fd
                                                    : session->client_fd;
@@ -87,19 +107,21 @@ static void on_client_read(struct selector_key *key) {
   }
 }
 
+// Handler de LECTURA: El cliente nos mandó datos.
+static void on_client_read(struct selector_key *key) {
+  client_t *session = key->data;
+
+  unsigned state = stm_handler_read(&session->stm, key);
+
+  session_step(key, session, state);
+}
+
 // Handler de ESCRITURA: El socket está listo para enviar datos.
 static void on_client_write(struct selector_key *key) {
   client_t *session = key->data;
   unsigned state = stm_handler_write(&session->stm, key);
 
-  if (state == ERROR || state == DONE) {
-    int other_fd = (key->fd == session->client_fd) ? session->origin_fd
-                                                   : session->client_fd;
-    selector_unregister_fd(key->s, key->fd);
-    if (other_fd >= 0) {
-      selector_unregister_fd(key->s, other_fd);
-    }
-  }
+  session_step(key, session, state);
 }
 
 // Handler de CIERRE: El socket se cerró.
@@ -112,42 +134,37 @@ static void on_client_close(struct selector_key *key) {
 // Handler de BLOQUEO: Tarea bloqueante finalizó (ej: DNS)
 static void on_client_block(struct selector_key *key) {
   client_t *session = key->data;
+  // El fd pudo haberse reutilizado por una sesión que no espera trabajos
+  if (session->stm.current == NULL ||
+      session->stm.current->on_block_ready == NULL) {
+    return;
+  }
   unsigned state = stm_handler_block(&session->stm, key);
 
-  if (state == ERROR || state == DONE) {
-    int other_fd = (key->fd == session->client_fd) ? session->origin_fd
-                                                   : session->client_fd;
-    selector_unregister_fd(key->s, key->fd);
-    if (other_fd >= 0) {
-      selector_unregister_fd(key->s, other_fd);
-    }
+  session_step(key, session, state);
+}
+
+// Cuenta los clientes que abrieron con TCP Fast Open (datos en el SYN)
+static void count_tfo_accept(int fd) {
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 &&
+      (info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+    tfo_accept();
   }
 }
 
-// Handler PÚBLICO: Acepta nuevas conexiones SOCKS5.
-void socksv5_passive_accept(struct selector_key *key) {
+// Arma la sesión de un cliente recién aceptado
+static void accept_session(struct selector_key *key, int new_fd,
+                           const struct sockaddr *client_addr) {
   struct socks5args *args =
       key->data; // Obtenemos la configuración del servidor
-  struct sockaddr_storage client_addr;
-  socklen_t client_addr_len = sizeof(client_addr);
-
-  // 1. Aceptar conexión entrante
-  int new_fd =
-      accept(key->fd, (struct sockaddr *)&client_addr, &client_addr_len);
-  if (new_fd < 0) {
-    // Error temporal o fatal, por ahora solo logueamos
-    perror("accept()");
-    return;
-  }
 
-  // 2. Configurar NO BLOQUEANTE (Fundamental)
-  if (selector_fd_set_nio(new_fd) == -1) {
-    perror("selector_fd_set_nio()");
-    close(new_fd);
-    return;
-  }
+  sockopts_apply(new_fd, LEG_CLIENT);
+  count_tfo_accept(new_fd);
+  uniques_client(client_addr);
 
-  // 3. Crear estado para este nuevo cliente
+  // Crear estado para este nuevo cliente
   client_t *new_session = session_new(new_fd);
   if (new_session == NULL) {
     // Sin memoria
@@ -157,8 +174,15 @@ void socksv5_passive_accept(struct selector_key *key) {
 
   // Vincular la configuración (usuarios para autenticación)
   new_session->args = args;
+  new_session->trusted = trusted_match(client_addr);
+  new_session->handshaking = true;
+  new_session->accepted_at = latency_clock();
+  admission_session_opened();
+  sessions_add(new_session);
+  // Antes de registrar: si falla, session_destroy ya descuenta la conexión
+  start_connection();
 
-  // 4. Registrar en el selector
+  // Registrar en el selector
   // Nos interesa leer (OP_READ) inicialmente
   selector_status ss = selector_register(key->s, new_fd, &session_handlers,
                                          OP_READ, new_session);
@@ -166,10 +190,48 @@ void socksv5_passive_accept(struct selector_key *key) {
   if (ss != SELECTOR_SUCCESS) {
     fprintf(stderr, "Error registering client in selector: %s\n",
             selector_error(ss));
+    if (ss == SELECTOR_MAXFD) {
+      // fd fuera del rango del selector: es otra forma de quedarnos sin fds
+      admission_fd_exhausted();
+    }
     session_destroy(new_session); // Esto cierra el fd y libera memoria
     return;
   }
 
-  start_connection();
   printf("New connection accepted for fd %d\n", new_fd);
 }
+
+// Handler PÚBLICO: Acepta nuevas conexiones SOCKS5.
+// Vacía la cola del listener hasta ACCEPT_BUDGET conexiones por evento: en
+// una ráfaga no pagamos un select por conexión, y el presupuesto evita que
+// la ráfaga demore a las sesiones que ya están en curso.
+void socksv5_passive_accept(struct selector_key *key) {
+  for (int i = 0; i < ACCEPT_BUDGET; i++) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+
+    // accept4 ya lo deja no bloqueante (Fundamental)
+    int new_fd = accept4(key->fd, (struct sockaddr *)&client_addr,
+                         &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (new_fd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return; // cola vacía
+      }
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue; // el cliente abortó antes del accept
+      }
+      if (errno == EMFILE || errno == ENFILE) {
+        // El listener sigue legible: sin pausarlo el loop giraría sin parar
+        admission_fd_exhausted();
+        return;
+      }
+      perror("accept4()");
+      return;
+    }
+    if (admission_should_shed()) {
+      admission_reject(new_fd);
+      continue;
+    }
+    accept_session(key, new_fd, (struct sockaddr *)&client_addr);
+  }
+}
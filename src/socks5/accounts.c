@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "accounts.h"
+
+/** buckets de la tabla de cuentas (potencia de 2) */
+#define ACCOUNTS_BUCKETS 1024
+/** cada cuánto se reponen tokens mientras haya sesiones estacionadas */
+#define REFILL_INTERVAL_MS 10
+/**
+ * Capacidad del bucket: la tasa de esta ventana, pero al menos
+ * min(tasa, ACCOUNT_MIN_BURST) para no fragmentar lecturas a tasas bajas.
+ */
+#define BURST_WINDOW_MS 100
+#define ACCOUNT_MIN_BURST 16384
+/** con menos tokens que esto (o que la capacidad del bucket) no se lee */
+#define ACCOUNT_MIN_READ 1500
+
+struct account {
+  char *name;
+  unsigned hash;
+
+  /** si false se aplican los límites por defecto */
+  bool custom;
+  struct account_limits limits;
+
+  unsigned sessions;
+
+  /** totales desde que se creó la cuenta */
+  uint64_t bytes_up, bytes_down;
+  uint64_t total_sessions, errors;
+
+  int64_t tokens;
+  uint64_t last_refill; // ns de CLOCK_MONOTONIC
+
+  /** sesiones estacionadas, en orden de llegada */
+  struct account_waiter *waiters_head, *waiters_tail;
+  /** encadenamiento en la lista de cuentas con sesiones estacionadas */
+  struct account *parked_next;
+  bool in_parked;
+
+  struct account *next; // bucket
+};
+
+static struct account *buckets[ACCOUNTS_BUCKETS];
+static struct account_limits defaults = {.weight = 1};
+
+static struct account *parked = NULL;
+static unsigned long refill_timer = 0;
+
+static unsigned name_hash(const char *name) {
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (const char *c = name; *c != '\0'; c++) {
+    h ^= (unsigned char)*c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const struct account_limits *limits_of(const struct account *a) {
+  return a->custom ? &a->limits : &defaults;
+}
+
+static int64_t burst_of(uint64_t rate) {
+  uint64_t burst = rate * BURST_WINDOW_MS / 1000;
+  uint64_t min = rate < ACCOUNT_MIN_BURST ? rate : ACCOUNT_MIN_BURST;
+  return burst > min ? burst : min;
+}
+
+static void refill(struct account *a, uint64_t now) {
+  uint64_t rate = limits_of(a)->rate;
+  if (rate != 0 && now > a->last_refill) {
+    int64_t burst = burst_of(rate);
+    double added = (double)rate * (now - a->last_refill) / 1e9;
+    // con deuda o cerca del tope: evitamos desbordes con tiempos largos
+    a->tokens = added >= (double)(burst - a->tokens)
+                    ? burst
+                    : a->tokens + (int64_t)added;
+  }
+  a->last_refill = now;
+}
+
+// Retorna la cuenta de `name', creándola si `create'
+static struct account *lookup(const char *name, bool create) {
+  unsigned hash = name_hash(name);
+  struct account **bucket = &buckets[hash & (ACCOUNTS_BUCKETS - 1)];
+  for (struct account *a = *bucket; a != NULL; a = a->next) {
+    if (a->hash == hash && strcmp(a->name, name) == 0) {
+      return a;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  struct account *a = calloc(1, sizeof(*a));
+  if (a == NULL) {
+    return NULL;
+  }
+  a->name = strdup(name);
+  if (a->name == NULL) {
+    free(a);
+    return NULL;
+  }
+  a->hash = hash;
+  a->last_refill = monotonic_ns();
+  a->tokens = burst_of(limits_of(a)->rate);
+  // las cuentas no se liberan: hay una por identidad conocida
+  a->next = *bucket;
+  *bucket = a;
+  return a;
+}
+
+bool accounts_acquire(const char *username, struct account **out) {
+  *out = NULL;
+  if (username == NULL || username[0] == '\0') {
+    return true;
+  }
+  struct account *a = lookup(username, true);
+  if (a == NULL) {
+    // sin memoria para la cuenta: no la limitamos antes que cortar la sesión
+    return true;
+  }
+  unsigned max = limits_of(a)->max_sessions;
+  if (max != 0 && a->sessions >= max) {
+    return false;
+  }
+  a->sessions++;
+  a->total_sessions++;
+  *out = a;
+  return true;
+}
+
+static void waiter_unlink(struct account *a, struct account_waiter *w) {
+  if (w->prev != NULL) {
+    w->prev->next = w->next;
+  } else {
+    a->waiters_head = w->next;
+  }
+  if (w->next != NULL) {
+    w->next->prev = w->prev;
+  } else {
+    a->waiters_tail = w->prev;
+  }
+  w->prev = w->next = NULL;
+  w->parked = false;
+}
+
+void accounts_release(struct account *a, struct account_waiter *w) {
+  if (a == NULL) {
+    return;
+  }
+  if (w != NULL && w->parked) {
+    waiter_unlink(a, w);
+  }
+  a->sessions--;
+}
+
+// Saldo a partir del cual vale la pena leer: esperamos el tick antes que
+// leer de a pocos bytes recién repuestos. Cuenta con límite
+static int64_t resume_threshold(struct account *a) {
+  uint64_t burst = burst_of(limits_of(a)->rate);
+  return burst < ACCOUNT_MIN_READ ? (int64_t)burst : ACCOUNT_MIN_READ;
+}
+
+size_t accounts_allowance(struct account *a, size_t want) {
+  if (a == NULL || limits_of(a)->rate == 0) {
+    return want;
+  }
+  refill(a, monotonic_ns());
+  int64_t min = resume_threshold(a);
+  if ((uint64_t)min > want) {
+    min = want;
+  }
+  if (a->tokens <= 0 || a->tokens < min) {
+    return 0;
+  }
+  return (uint64_t)a->tokens < want ? (size_t)a->tokens : want;
+}
+
+void accounts_charge(struct account *a, size_t n, bool upstream) {
+  if (a == NULL) {
+    return;
+  }
+  if (upstream) {
+    a->bytes_up += n;
+  } else {
+    a->bytes_down += n;
+  }
+  if (limits_of(a)->rate != 0) {
+    a->tokens -= n;
+  }
+}
+
+void accounts_failed(struct account *a) {
+  if (a != NULL) {
+    a->errors++;
+  }
+}
+
+unsigned accounts_weight(const struct account *a) {
+  if (a == NULL) {
+    return 1;
+  }
+  unsigned weight = limits_of(a)->weight;
+  return weight == 0 ? 1 : weight;
+}
+
+static void refill_tick(fd_selector s, void *data);
+
+static void arm_refill(fd_selector s) {
+  if (refill_timer == 0) {
+    refill_timer = selector_timer_add(s, REFILL_INTERVAL_MS, refill_tick, NULL);
+  }
+}
+
+static void mark_parked(struct account *a) {
+  if (!a->in_parked) {
+    a->in_parked = true;
+    a->parked_next = parked;
+    parked = a;
+  }
+}
+
+void accounts_park(struct account *a, struct account_waiter *w,
+                   fd_selector s) {
+  if (a == NULL || w->parked) {
+    return;
+  }
+  w->parked = true;
+  w->next = NULL;
+  w->prev = a->waiters_tail;
+  if (a->waiters_tail != NULL) {
+    a->waiters_tail->next = w;
+  } else {
+    a->waiters_head = w;
+  }
+  a->waiters_tail = w;
+
+  mark_parked(a);
+  arm_refill(s);
+}
+
+static void refill_tick(fd_selector s, void *data) {
+  (void)data;
+  refill_timer = 0;
+  uint64_t now = monotonic_ns();
+
+  // desenganchamos la lista: al despertar, las sesiones pueden volver a
+  // estacionarse y reencolar su cuenta
+  struct account *list = parked;
+  parked = NULL;
+  while (list != NULL) {
+    struct account *a = list;
+    list = a->parked_next;
+    a->in_parked = false;
+    if (a->waiters_head == NULL) {
+      continue;
+    }
+    refill(a, now);
+    // con menos saldo accounts_allowance daría 0 y la sesión volvería a
+    // estacionarse enseguida
+    if (limits_of(a)->rate != 0 &&
+        (a->tokens <= 0 || a->tokens < resume_threshold(a))) {
+      mark_parked(a);
+      continue;
+    }
+
+    struct account_waiter *w = a->waiters_head;
+    a->waiters_head = a->waiters_tail = NULL;
+    while (w != NULL) {
+      struct account_waiter *next = w->next;
+      w->prev = w->next = NULL;
+      w->parked = false;
+      w->resume(w, s);
+      w = next;
+    }
+  }
+
+  if (parked != NULL) {
+    arm_refill(s);
+  }
+}
+
+bool accounts_set_limits(const char *username,
+                         const struct account_limits *limits) {
+  if (username == NULL || limits == NULL) {
+    return false;
+  }
+  if (strcmp(username, "*") == 0) {
+    defaults = *limits;
+    return true;
+  }
+  struct account *a = lookup(username, true);
+  if (a == NULL) {
+    return false;
+  }
+  a->custom = true;
+  a->limits = *limits;
+  // las sesiones estacionadas se reevalúan en el próximo tick
+  return true;
+}
+
+char *accounts_list(void) {
+  size_t size = 128, pos = 0;
+  for (unsigned b = 0; b < ACCOUNTS_BUCKETS; b++) {
+    for (struct account *a = buckets[b]; a != NULL; a = a->next) {
+      size += strlen(a->name) + 80;
+    }
+  }
+  char *out = malloc(size);
+  if (out == NULL) {
+    return NULL;
+  }
+
+  // Formato: usuario:max_sesiones:bytes_por_segundo:peso sessions=vivas\r\n
+  pos += snprintf(out + pos, size - pos, "*:%u:%llu:%u\r\n",
+                  defaults.max_sessions, (unsigned long long)defaults.rate,
+                  defaults.weight);
+  for (unsigned b = 0; b < ACCOUNTS_BUCKETS; b++) {
+    for (struct account *a = buckets[b]; a != NULL; a = a->next) {
+      if (!a->custom && a->sessions == 0) {
+        continue;
+      }
+      const struct account_limits *l = limits_of(a);
+      pos += snprintf(out + pos, size - pos, "%s:%u:%llu:%u sessions=%u%s\r\n",
+                      a->name, l->max_sessions, (unsigned long long)l->rate,
+                      l->weight, a->sessions, a->custom ? "" : " (default)");
+    }
+  }
+  return out;
+}
+
+static int by_traffic_desc(const void *x, const void *y) {
+  const struct account *a = *(struct account *const *)x;
+  const struct account *b = *(struct account *const *)y;
+  uint64_t ta = a->bytes_up + a->bytes_down, tb = b->bytes_up + b->bytes_down;
+  return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+// Hay una cuenta por identidad conocida: ordenarlas todas es exacto y barato
+char *accounts_top(unsigned k) {
+  size_t count = 0;
+  for (unsigned b = 0; b < ACCOUNTS_BUCKETS; b++) {
+    for (struct account *a = buckets[b]; a != NULL; a = a->next) {
+      count++;
+    }
+  }
+  struct account **all = malloc(count * sizeof(*all) + 1);
+  if (all == NULL) {
+    return NULL;
+  }
+  size_t n = 0;
+  for (unsigned b = 0; b < ACCOUNTS_BUCKETS; b++) {
+    for (struct account *a = buckets[b]; a != NULL; a = a->next) {
+      all[n++] = a;
+    }
+  }
+  qsort(all, count, sizeof(*all), by_traffic_desc);
+  if (k < count) {
+    count = k;
+  }
+
+  size_t size = 1, pos = 0;
+  for (size_t i = 0; i < count; i++) {
+    size += strlen(all[i]->name) + 112;
+  }
+  char *out = malloc(size);
+  if (out == NULL) {
+    free(all);
+    return NULL;
+  }
+  out[0] = '\0';
+
+  // Formato: usuario up=bytes down=bytes sessions=n errors=n\r\n
+  for (size_t i = 0; i < count; i++) {
+    const struct account *a = all[i];
+    pos += snprintf(out + pos, size - pos,
+                    "%s up=%llu down=%llu sessions=%llu errors=%llu\r\n",
+                    a->name, (unsigned long long)a->bytes_up,
+                    (unsigned long long)a->bytes_down,
+                    (unsigned long long)a->total_sessions,
+                    (unsigned long long)a->errors);
+  }
+  free(all);
+  return out;
+}
@@ -0,0 +1,102 @@
+#ifndef ACCOUNTS_H
+#define ACCOUNTS_H
+
+#include "../lib/selector.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * accounts.c - límites por usuario
+ *
+ * Cada identidad autenticada (usuario RFC 1929 o identidad de red de
+ * confianza) tiene una cuenta con la cantidad de sesiones vivas y un token
+ * bucket de bytes. Las sesiones se cobran al autenticarse y se devuelven al
+ * cerrarse; los bytes se cobran al leerlos de cualquiera de los dos extremos.
+ *
+ * Cuando el bucket se vacía, la sesión se estaciona (deja de leer, nunca se
+ * descartan datos) y un timer del selector repone los tokens según el tiempo
+ * transcurrido y la despierta. El timer sólo está armado mientras haya
+ * sesiones estacionadas.
+ *
+ * Cada cuenta acumula además su tráfico: bytes en cada sentido, sesiones y
+ * sesiones que terminaron en error.
+ *
+ * Los límites se cambian en caliente desde management. Un usuario sin límites
+ * propios usa los límites por defecto (`*'). 0 significa sin límite.
+ *
+ * Sólo desde el hilo del selector.
+ */
+struct account;
+
+/**
+ * Espera de cupo. Se embebe en la sesión; `resume' corre desde el timer
+ * cuando la cuenta vuelve a tener tokens (o dejó de tener límite).
+ */
+struct account_waiter {
+  void (*resume)(struct account_waiter *w, fd_selector s);
+  struct account_waiter *prev, *next;
+  bool parked;
+};
+
+/** límites de una cuenta (o los por defecto) */
+struct account_limits {
+  /** sesiones simultáneas */
+  unsigned max_sessions;
+  /** bytes por segundo, sumando ambos sentidos */
+  uint64_t rate;
+  /** peso de sus sesiones en el reparto de la capacidad global (>= 1) */
+  unsigned weight;
+};
+
+/**
+ * Cobra una sesión a `username'. Retorna false si el usuario está en su tope
+ * de sesiones. Si `username' está vacío (sesión anónima) no hay cuenta y
+ * `*out' queda en NULL.
+ */
+bool accounts_acquire(const char *username, struct account **out);
+
+/** devuelve la sesión y cancela su espera si estaba estacionada */
+void accounts_release(struct account *a, struct account_waiter *w);
+
+/**
+ * Cuántos de `want' bytes puede leer ahora la cuenta (0 = tiene que
+ * estacionarse). Una cuenta NULL no tiene límite.
+ */
+size_t accounts_allowance(struct account *a, size_t want);
+
+/**
+ * descuenta `n' bytes leídos y los suma al total del sentido: `upstream' si
+ * se leyeron del cliente
+ */
+void accounts_charge(struct account *a, size_t n, bool upstream);
+
+/** la sesión terminó en error */
+void accounts_failed(struct account *a);
+
+/** peso de las sesiones de la cuenta en el scheduler. NULL pesa 1 */
+unsigned accounts_weight(const struct account *a);
+
+/** estaciona `w' hasta que la cuenta tenga tokens */
+void accounts_park(struct account *a, struct account_waiter *w,
+                   fd_selector s);
+
+/**
+ * Cambia los límites de `username', o los por defecto si es "*".
+ * Las sesiones vivas no se cortan si el nuevo tope es menor.
+ */
+bool accounts_set_limits(const char *username,
+                         const struct account_limits *limits);
+
+/**
+ * Listado de límites: una línea por cuenta con límites propios o sesiones
+ * vivas, precedido por los por defecto. El caller libera el string.
+ */
+char *accounts_list(void);
+
+/**
+ * Las `k' cuentas que más bytes movieron, de mayor a menor, con sus totales.
+ * El caller libera el string.
+ */
+char *accounts_top(unsigned k);
+
+#endif
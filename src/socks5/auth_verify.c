@@ -0,0 +1,172 @@
+#include "auth_verify.h"
+#include "lib/workers.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** hilos del pool verificador: tope de KDFs simultáneos */
+#define AUTH_VERIFIER_THREADS 4
+
+enum auth_job_kind {
+  JOB_VERIFY,
+  JOB_DUMMY,  // usuario inexistente: KDF contra `dummy' y falla
+  JOB_DERIVE, // alta: deriva `verifier'
+};
+
+struct auth_job {
+  /** trabajo encolado en el pool (debe ir primero) */
+  struct worker_job job;
+
+  enum auth_job_kind kind;
+
+  fd_selector s;
+  int fd;
+  user_verifier verifier;
+  char password[256];
+
+  /** una por el trabajo en el pool y otra por la sesión */
+  unsigned references;
+  bool cancelled;
+  bool done;
+  bool success;
+};
+
+/** protege las referencias y los flags de todos los trabajos */
+static pthread_mutex_t auth_mutex = PTHREAD_MUTEX_INITIALIZER;
+static worker_pool verifiers = NULL;
+
+/** verificador de los usuarios inexistentes: mismo costo que uno real */
+static const user_verifier dummy = {
+    .salt = "socks5d-no-user",
+    .iterations = USER_KDF_ITERATIONS,
+};
+
+static void job_unref(struct auth_job *j) {
+  j->references--;
+  if (j->references == 0) {
+    memset(j->password, 0, sizeof(j->password));
+    free(j);
+  }
+}
+
+static void auth_verify_run(struct worker_job *job) {
+  struct auth_job *j = (struct auth_job *)job;
+
+  pthread_mutex_lock(&auth_mutex);
+  bool cancelled = j->cancelled;
+  if (cancelled) {
+    job_unref(j);
+  }
+  pthread_mutex_unlock(&auth_mutex);
+  if (cancelled) {
+    return;
+  }
+
+  bool success = false;
+  switch (j->kind) {
+  case JOB_VERIFY:
+    success = verify_password(&j->verifier, j->password);
+    break;
+  case JOB_DUMMY:
+    verify_password(&j->verifier, j->password);
+    break;
+  case JOB_DERIVE:
+    // `verifier' se publica con `done', bajo el mutex
+    success = new_verifier(j->password, &j->verifier);
+    break;
+  }
+
+  pthread_mutex_lock(&auth_mutex);
+  j->success = success;
+  j->done = true;
+  bool notify = !j->cancelled;
+  fd_selector s = j->s;
+  int fd = j->fd;
+  job_unref(j);
+  pthread_mutex_unlock(&auth_mutex);
+
+  if (notify) {
+    selector_notify_block(s, fd);
+  }
+}
+
+bool auth_verify_init(void) {
+  verifiers = workers_new(AUTH_VERIFIER_THREADS);
+  return verifiers != NULL;
+}
+
+static struct auth_job *job_start(fd_selector s, int fd,
+                                  enum auth_job_kind kind,
+                                  const user_verifier *v,
+                                  const char *password) {
+  struct auth_job *j = calloc(1, sizeof(*j));
+  if (j == NULL) {
+    return NULL;
+  }
+  j->job.run = auth_verify_run;
+  j->kind = kind;
+  j->s = s;
+  j->fd = fd;
+  if (v != NULL) {
+    j->verifier = *v;
+  }
+  strncpy(j->password, password, sizeof(j->password) - 1);
+  j->references = 2;
+
+  if (!workers_submit(verifiers, &j->job)) {
+    memset(j->password, 0, sizeof(j->password));
+    free(j);
+    return NULL;
+  }
+  return j;
+}
+
+struct auth_job *auth_verify_start(fd_selector s, int fd,
+                                   const user_verifier *v,
+                                   const char *password) {
+  if (v == NULL) {
+    return job_start(s, fd, JOB_DUMMY, &dummy, password);
+  }
+  return job_start(s, fd, JOB_VERIFY, v, password);
+}
+
+struct auth_job *auth_derive_start(fd_selector s, int fd,
+                                   const char *password) {
+  return job_start(s, fd, JOB_DERIVE, NULL, password);
+}
+
+bool auth_verify_done(struct auth_job *job, bool *success) {
+  pthread_mutex_lock(&auth_mutex);
+  bool done = job->done;
+  if (done) {
+    *success = job->success;
+  }
+  pthread_mutex_unlock(&auth_mutex);
+  return done;
+}
+
+const user_verifier *auth_verify_verifier(const struct auth_job *job) {
+  // Sólo se llama con el trabajo terminado: el pool ya no lo escribe
+  return &job->verifier;
+}
+
+bool auth_verify_accept(struct auth_job *job, const char *username,
+                        const char *password) {
+  user_verifier v;
+  if (job->kind != JOB_VERIFY || !get_user_verifier(username, &v) ||
+      !same_verifier(&v, &job->verifier)) {
+    return false;
+  }
+  cache_credentials(username, &v, password);
+  return true;
+}
+
+void auth_verify_release(struct auth_job *job) {
+  if (job == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&auth_mutex);
+  job->cancelled = true;
+  job_unref(job);
+  pthread_mutex_unlock(&auth_mutex);
+}
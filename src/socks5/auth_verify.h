@@ -0,0 +1,68 @@
+#ifndef AUTH_VERIFY_H
+#define AUTH_VERIFY_H
+
+#include "../lib/selector.h"
+#include "management/mng_users.h"
+#include <stdbool.h>
+
+/**
+ * auth_verify.c - KDF de contraseñas fuera del hilo del selector
+ *
+ * Correr el KDF cuesta decenas de milisegundos de CPU, así que cada
+ * verificación (y cada derivación de un alta) se encola en un pool de hilos y
+ * al terminar se notifica a la conexión con `selector_notify_block'. El
+ * trabajo tiene dos referencias (el pool y la conexión); si la conexión lo
+ * suelta antes de que empiece, el KDF no se ejecuta.
+ */
+struct auth_job;
+
+/** levanta el pool verificador. Retorna false ante error */
+bool auth_verify_init(void);
+
+/**
+ * Encola la verificación de `password' contra `v'. Al terminar se notifica
+ * `fd' en el selector `s'. Retorna NULL si no hay memoria o pool.
+ *
+ * Con `v' NULL (usuario inexistente) corre el mismo KDF contra un verificador
+ * fijo y siempre falla: la respuesta tarda lo mismo que con un usuario real,
+ * así que no revela qué usuarios existen.
+ */
+struct auth_job *auth_verify_start(fd_selector s, int fd,
+                                   const user_verifier *v,
+                                   const char *password);
+
+/**
+ * Encola la derivación de un verificador nuevo para `password' (ver
+ * new_verifier). Al terminar queda en auth_verify_verifier.
+ */
+struct auth_job *auth_derive_start(fd_selector s, int fd,
+                                   const char *password);
+
+/**
+ * Indica si el trabajo terminó y, en ese caso, deja el resultado en
+ * `success'.
+ */
+bool auth_verify_done(struct auth_job *job, bool *success);
+
+/**
+ * Verificador contra el que se comparó la contraseña o, en una derivación
+ * terminada, el derivado.
+ */
+const user_verifier *auth_verify_verifier(const struct auth_job *job);
+
+/**
+ * Confirma una verificación exitosa: vale sólo si `username' sigue teniendo
+ * el verificador contra el que se comparó (pudo borrarse o cambiar de
+ * contraseña mientras tanto). En ese caso se cachea. Sólo desde el hilo del
+ * selector.
+ */
+bool auth_verify_accept(struct auth_job *job, const char *username,
+                        const char *password);
+
+/**
+ * Suelta la referencia de la conexión. Si el trabajo no terminó queda
+ * cancelado: no se ejecuta (o no notifica). Tolera NULL.
+ */
+void auth_verify_release(struct auth_job *job);
+
+#endif
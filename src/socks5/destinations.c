@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "destinations.h"
+#include "topk.h"
+
+/** destinos seguidos: cualquiera con más de 1/1024 del tráfico está */
+#define DESTINATIONS_TRACKED 1024
+
+static topk tracked = NULL;
+
+void destinations_charge(const char *destination, uint64_t bytes) {
+  if (tracked == NULL) {
+    tracked = topk_new(DESTINATIONS_TRACKED);
+  }
+  topk_add(tracked, destination, bytes);
+}
+
+char *destinations_top(unsigned k) {
+  struct topk_item *items = malloc(k * sizeof(*items) + 1);
+  if (items == NULL) {
+    return NULL;
+  }
+  size_t n = topk_list(tracked, items, k);
+  size_t size = n * (TOPK_KEY_MAX + 64) + 1, pos = 0;
+  char *out = malloc(size);
+  if (out == NULL) {
+    free(items);
+    return NULL;
+  }
+  out[0] = '\0';
+
+  // Formato: destino bytes=estimado error=sobreestimación máxima\r\n
+  for (size_t i = 0; i < n; i++) {
+    pos += snprintf(out + pos, size - pos, "%s bytes=%llu error=%llu\r\n",
+                    items[i].key, (unsigned long long)items[i].weight,
+                    (unsigned long long)items[i].error);
+  }
+  free(items);
+  return out;
+}
@@ -0,0 +1,26 @@
+#ifndef DESTINATIONS_H
+#define DESTINATIONS_H
+
+#include <stdint.h>
+
+/**
+ * destinations.c - destinos con más tráfico
+ *
+ * Las sesiones suman sus bytes al destino que pidieron. Con millones de
+ * destinos distintos no podemos contarlos a todos: se siguen los más
+ * pesados con memoria acotada (ver lib/topk.h), así que los totales son
+ * estimaciones con una cota de error conocida.
+ *
+ * Sólo desde el hilo del selector.
+ */
+
+/** suma `bytes' a `destination' */
+void destinations_charge(const char *destination, uint64_t bytes);
+
+/**
+ * Los `k' destinos que más bytes movieron, de mayor a menor. El caller
+ * libera el string.
+ */
+char *destinations_top(unsigned k);
+
+#endif
@@ -1,36 +1,647 @@
 #include "dns.h"
+#include "lib/workers.h"
+#include "management/metrics.h"
+#include <arpa/inet.h>
+#include <ctype.h>
 #include <netdb.h>
 #include <selector.h>
-#include <socks5.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+/** segundos que una respuesta es válida en la caché */
+#define DNS_CACHE_TTL 60
+/** segundos antes del vencimiento en los que una entrada puede refrescarse */
+#define DNS_REFRESH_WINDOW 15
+/** pedidos desde la última resolución para considerar caliente una entrada */
+#define DNS_REFRESH_MIN_HITS 2
+/** refrescos en segundo plano simultáneos como máximo */
+#define DNS_MAX_REFRESHES 4
+/** hilos del pool resolvedor: tope de getaddrinfo simultáneos */
+#define DNS_RESOLVER_THREADS 16
+/** cantidad máxima de nombres en la caché (se descarta el menos usado) */
+#define DNS_CACHE_MAX 4096
+#define DNS_CACHE_BUCKETS 1024
+/** entradas de la tabla estática de hosts */
+#define DNS_HOSTS_BUCKETS 256
+#define DNS_HOST_MAX_ADDRS 8
+
+/** sesión suscripta a una consulta */
+struct dns_waiter {
+  fd_selector s;
+  int fd;
+  struct dns_waiter *next;
+};
+
+struct dns_query {
+  /** trabajo encolado en el pool resolvedor (debe ir primero) */
+  struct worker_job job;
+
+  char host[256];
+  /**
+   * una referencia por el trabajo en el pool y una por cada suscriptor. Cada
+   * suscriptor es a la vez el token de cancelación de su sesión: una consulta
+   * sin suscriptores (que no sea un refresco) ya no le importa a nadie.
+   */
+  unsigned references;
+  bool done;
+  /** lanzada por la caché para renovar una entrada, sin suscriptores propios */
+  bool refresh;
+
+  /** primera dirección resuelta (sin puerto) */
+  bool resolved;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  int domain;
+
+  struct dns_waiter *waiters;
+
+  /** siguiente consulta en vuelo */
+  struct dns_query *next;
+};
+
+/** respuesta cacheada para un nombre */
+struct dns_entry {
+  char host[256];
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  int domain;
+
+  time_t expires;
+  /** pedidos desde la última resolución: mide la popularidad */
+  unsigned hits;
+  bool refreshing;
+  /** la respuesta vigente la trajo un refresco proactivo */
+  bool refreshed;
+
+  struct dns_entry *hnext;
+  /** lista LRU, la cabeza es la más usada */
+  struct dns_entry *prev, *next;
+};
+
+/**
+ * host con direcciones fijas configuradas por gestión. Sólo se accede desde el
+ * hilo del selector, por eso la tabla no está bajo `dns_mutex'.
+ */
+struct dns_host {
+  char host[256];
+  size_t count;
+  /** próxima dirección a entregar: se reparten en round-robin */
+  size_t next;
+  struct sockaddr_storage addrs[DNS_HOST_MAX_ADDRS];
+  socklen_t lens[DNS_HOST_MAX_ADDRS];
+
+  struct dns_host *hnext;
+};
+
+static struct dns_host *hosts[DNS_HOSTS_BUCKETS];
+
+/** protege las consultas en vuelo, la caché y los campos de cada consulta */
+static pthread_mutex_t dns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_query *inflight = NULL;
+static worker_pool resolvers = NULL;
+
+static struct dns_entry *buckets[DNS_CACHE_BUCKETS];
+static struct dns_entry *lru_head = NULL, *lru_tail = NULL;
+static size_t cache_size = 0;
+static unsigned refreshes = 0;
+
+static time_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static unsigned host_hash(const char *host, unsigned buckets) {
+  // FNV-1a sin distinguir mayúsculas, igual que el DNS
+  unsigned h = 2166136261u;
+  for (const char *c = host; *c != '\0'; c++) {
+    h ^= (unsigned char)tolower((unsigned char)*c);
+    h *= 16777619u;
+  }
+  return h % buckets;
+}
+
+static void lru_unlink(struct dns_entry *e) {
+  if (e->prev != NULL) {
+    e->prev->next = e->next;
+  } else {
+    lru_head = e->next;
+  }
+  if (e->next != NULL) {
+    e->next->prev = e->prev;
+  } else {
+    lru_tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+}
+
+static void lru_push(struct dns_entry *e) {
+  e->prev = NULL;
+  e->next = lru_head;
+  if (lru_head != NULL) {
+    lru_head->prev = e;
+  }
+  lru_head = e;
+  if (lru_tail == NULL) {
+    lru_tail = e;
+  }
+}
+
+static struct dns_entry *cache_find(const char *host) {
+  struct dns_entry *e = buckets[host_hash(host, DNS_CACHE_BUCKETS)];
+  while (e != NULL && strcasecmp(e->host, host) != 0) {
+    e = e->hnext;
+  }
+  return e;
+}
+
+static void cache_evict(struct dns_entry *e) {
+  struct dns_entry **it = &buckets[host_hash(e->host, DNS_CACHE_BUCKETS)];
+  while (*it != e) {
+    it = &(*it)->hnext;
+  }
+  *it = e->hnext;
+  lru_unlink(e);
+  cache_size--;
+  free(e);
+}
+
+static void cache_store(const struct dns_query *q) {
+  struct dns_entry *e = cache_find(q->host);
+  if (e == NULL) {
+    if (cache_size >= DNS_CACHE_MAX) {
+      cache_evict(lru_tail);
+    }
+    e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+      return;
+    }
+    strncpy(e->host, q->host, sizeof(e->host) - 1);
+    unsigned h = host_hash(e->host, DNS_CACHE_BUCKETS);
+    e->hnext = buckets[h];
+    buckets[h] = e;
+    lru_push(e);
+    cache_size++;
+  }
+  e->addr = q->addr;
+  e->addr_len = q->addr_len;
+  e->domain = q->domain;
+  e->expires = now() + DNS_CACHE_TTL;
+  e->hits = 0;
+  e->refreshed = q->refresh;
+}
+
+static void inflight_remove(struct dns_query *q) {
+  struct dns_query **it = &inflight;
+  while (*it != NULL) {
+    if (*it == q) {
+      *it = q->next;
+      q->next = NULL;
+      return;
+    }
+    it = &(*it)->next;
+  }
+}
+
+static void query_unref(struct dns_query *q) {
+  q->references--;
+  if (q->references == 0) {
+    free(q);
+  }
+}
+
+// Publica el resultado y notifica a los suscriptores. La lista se desengancha
+// bajo el lock y se notifica afuera: el selector toma su propio mutex y desde
+// el hilo principal se entra a este módulo con ese mutex tomado.
+static void query_complete(struct dns_query *q, struct addrinfo *res) {
+  pthread_mutex_lock(&dns_mutex);
+  if (res != NULL) {
+    memcpy(&q->addr, res->ai_addr, res->ai_addrlen);
+    q->addr_len = res->ai_addrlen;
+    q->domain = res->ai_family;
+    q->resolved = true;
+    cache_store(q);
+  }
+  if (q->refresh) {
+    // si falló, la entrada vieja sigue vigente hasta vencer
+    struct dns_entry *e = cache_find(q->host);
+    if (e != NULL) {
+      e->refreshing = false;
+    }
+    refreshes--;
+  }
+  q->done = true;
+  inflight_remove(q);
+  struct dns_waiter *w = q->waiters;
+  q->waiters = NULL;
+  query_unref(q); // referencia del trabajo en el pool
+  pthread_mutex_unlock(&dns_mutex);
+
+  if (res != NULL) {
+    freeaddrinfo(res);
+  }
+
+  while (w != NULL) {
+    struct dns_waiter *aux = w;
+    selector_notify_block(w->s, w->fd);
+    w = w->next;
+    free(aux);
+  }
+}
+
+static void dns_resolve(struct worker_job *job) {
+  struct dns_query *q = (struct dns_query *)job;
+
+  // Si todas las sesiones que esperaban se cerraron mientras la consulta
+  // estaba en la cola, no gastamos un hilo en resolverla. Se saca de las
+  // consultas en vuelo bajo el mismo lock para que nadie se suscriba a ella.
+  pthread_mutex_lock(&dns_mutex);
+  if (q->waiters == NULL && !q->refresh) {
+    printf("DNS: dropping cancelled lookup for %s\n", q->host);
+    dns_lookup_dropped();
+    q->done = true;
+    inflight_remove(q);
+    query_unref(q);
+    pthread_mutex_unlock(&dns_mutex);
+    return;
+  }
+  pthread_mutex_unlock(&dns_mutex);
 
-void *dns_resolve(void *s_key) {
-  struct selector_key *key = (struct selector_key *)s_key;
-  client_t *s = key->data;
   struct addrinfo hints = {
       .ai_family = AF_UNSPEC,
       .ai_socktype = SOCK_STREAM,
-      .ai_flags = AI_PASSIVE,
+      .ai_flags = 0,
       .ai_protocol = 0,
       .ai_canonname = NULL,
       .ai_addr = NULL,
       .ai_next = NULL,
   };
 
-  char port[10];
-  sprintf(port, "%d", s->request_parser.port);
+  // Resolvemos sin servicio: el puerto lo pone cada sesión, así la misma
+  // respuesta sirve a todos los suscriptores y a la caché.
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(q->host, NULL, &hints, &res) != 0) {
+    res = NULL;
+  }
+
+  query_complete(q, res);
+}
 
-  int error = getaddrinfo((const char *)s->request_parser.addr, port, &hints,
-                          &s->res_addr);
-  if (error) {
-    s->res_addr = NULL;
+/** crea una consulta en vuelo. Requiere `dns_mutex' tomado */
+static struct dns_query *query_new(const char *host, bool refresh) {
+  struct dns_query *q = calloc(1, sizeof(*q));
+  if (q == NULL) {
+    return NULL;
   }
-  s->current_res = s->res_addr;
+  q->job.run = dns_resolve;
+  strncpy(q->host, host, sizeof(q->host) - 1);
+  q->references = 1; // trabajo en el pool
+  q->refresh = refresh;
+  q->next = inflight;
+  inflight = q;
+  return q;
+}
 
-  selector_notify_block(key->s, key->fd);
+static void query_launch(struct dns_query *q) {
+  if (!workers_submit(resolvers, &q->job)) {
+    // Sin pool no hay resolución: se responde como nombre no resuelto
+    query_complete(q, NULL);
+  }
+}
+
+static void set_port(struct sockaddr_storage *addr, uint16_t port) {
+  if (addr->ss_family == AF_INET) {
+    ((struct sockaddr_in *)addr)->sin_port = htons(port);
+  } else if (addr->ss_family == AF_INET6) {
+    ((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+  }
+}
 
-  free(s_key);
+// Reconoce un literal IPv4 o IPv6 (este último opcionalmente entre corchetes)
+static bool parse_literal(const char *host, struct sockaddr_storage *addr,
+                          socklen_t *addr_len, int *domain) {
+  memset(addr, 0, sizeof(*addr));
 
-  return NULL;
-}
\ No newline at end of file
+  struct sockaddr_in *ip4 = (struct sockaddr_in *)addr;
+  if (inet_pton(AF_INET, host, &ip4->sin_addr) == 1) {
+    ip4->sin_family = AF_INET;
+    *addr_len = sizeof(struct sockaddr_in);
+    *domain = AF_INET;
+    return true;
+  }
+
+  char tmp[INET6_ADDRSTRLEN];
+  size_t len = strlen(host);
+  if (len >= 2 && host[0] == '[' && host[len - 1] == ']') {
+    host++;
+    len -= 2;
+  }
+  if (len >= sizeof(tmp)) {
+    return false;
+  }
+  memcpy(tmp, host, len);
+  tmp[len] = '\0';
+
+  struct sockaddr_in6 *ip6 = (struct sockaddr_in6 *)addr;
+  if (inet_pton(AF_INET6, tmp, &ip6->sin6_addr) == 1) {
+    ip6->sin6_family = AF_INET6;
+    *addr_len = sizeof(struct sockaddr_in6);
+    *domain = AF_INET6;
+    return true;
+  }
+
+  return false;
+}
+
+static struct dns_host *hosts_find(const char *host) {
+  struct dns_host *h = hosts[host_hash(host, DNS_HOSTS_BUCKETS)];
+  while (h != NULL && strcasecmp(h->host, host) != 0) {
+    h = h->hnext;
+  }
+  return h;
+}
+
+bool dns_static_lookup(const char *host, uint16_t port,
+                       struct sockaddr_storage *addr, socklen_t *addr_len,
+                       int *domain) {
+  if (parse_literal(host, addr, addr_len, domain)) {
+    set_port(addr, port);
+    return true;
+  }
+
+  struct dns_host *h = hosts_find(host);
+  if (h == NULL) {
+    return false;
+  }
+  size_t i = h->next;
+  h->next = (h->next + 1) % h->count;
+
+  memset(addr, 0, sizeof(*addr));
+  memcpy(addr, &h->addrs[i], h->lens[i]);
+  *addr_len = h->lens[i];
+  *domain = h->addrs[i].ss_family;
+  set_port(addr, port);
+  return true;
+}
+
+bool dns_hosts_add(const char *host, const char *addrs) {
+  if (host == NULL || addrs == NULL || *host == '\0' ||
+      strlen(host) >= sizeof(((struct dns_host *)0)->host)) {
+    return false;
+  }
+
+  struct dns_host tmp;
+  memset(&tmp, 0, sizeof(tmp));
+
+  // lista separada por comas
+  const char *cursor = addrs;
+  while (*cursor != '\0') {
+    const char *end = strchr(cursor, ',');
+    size_t len = end == NULL ? strlen(cursor) : (size_t)(end - cursor);
+    char literal[INET6_ADDRSTRLEN + 2];
+    if (len == 0 || len >= sizeof(literal) || tmp.count >= DNS_HOST_MAX_ADDRS) {
+      return false;
+    }
+    memcpy(literal, cursor, len);
+    literal[len] = '\0';
+
+    int domain;
+    if (!parse_literal(literal, &tmp.addrs[tmp.count], &tmp.lens[tmp.count],
+                       &domain)) {
+      return false;
+    }
+    tmp.count++;
+    cursor = end == NULL ? cursor + len : end + 1;
+  }
+  if (tmp.count == 0) {
+    return false;
+  }
+
+  // Reemplaza las direcciones si el host ya estaba
+  struct dns_host *h = hosts_find(host);
+  if (h == NULL) {
+    h = malloc(sizeof(*h));
+    if (h == NULL) {
+      return false;
+    }
+    unsigned b = host_hash(host, DNS_HOSTS_BUCKETS);
+    tmp.hnext = hosts[b];
+    hosts[b] = h;
+  } else {
+    tmp.hnext = h->hnext;
+  }
+  strncpy(tmp.host, host, sizeof(tmp.host) - 1);
+  *h = tmp;
+  return true;
+}
+
+bool dns_hosts_del(const char *host) {
+  if (host == NULL) {
+    return false;
+  }
+  struct dns_host **it = &hosts[host_hash(host, DNS_HOSTS_BUCKETS)];
+  while (*it != NULL) {
+    if (strcasecmp((*it)->host, host) == 0) {
+      struct dns_host *aux = *it;
+      *it = aux->hnext;
+      free(aux);
+      return true;
+    }
+    it = &(*it)->hnext;
+  }
+  return false;
+}
+
+char *dns_hosts_list(void) {
+  size_t size = 1, pos = 0;
+  for (unsigned b = 0; b < DNS_HOSTS_BUCKETS; b++) {
+    for (struct dns_host *h = hosts[b]; h != NULL; h = h->hnext) {
+      size += strlen(h->host) + 3 + h->count * (INET6_ADDRSTRLEN + 1);
+    }
+  }
+  char *out = malloc(size);
+  if (out == NULL) {
+    return NULL;
+  }
+  out[0] = '\0';
+
+  // Formato: host=addr[,addr...]\r\n
+  for (unsigned b = 0; b < DNS_HOSTS_BUCKETS; b++) {
+    for (struct dns_host *h = hosts[b]; h != NULL; h = h->hnext) {
+      pos += snprintf(out + pos, size - pos, "%s=", h->host);
+      for (size_t i = 0; i < h->count; i++) {
+        char ip[INET6_ADDRSTRLEN] = "?";
+        const void *src =
+            h->addrs[i].ss_family == AF_INET
+                ? (const void *)&((struct sockaddr_in *)&h->addrs[i])->sin_addr
+                : (const void *)&((struct sockaddr_in6 *)&h->addrs[i])
+                      ->sin6_addr;
+        inet_ntop(h->addrs[i].ss_family, src, ip, sizeof(ip));
+        pos += snprintf(out + pos, size - pos, "%s%s", i == 0 ? "" : ",", ip);
+      }
+      pos += snprintf(out + pos, size - pos, "\r\n");
+    }
+  }
+
+  return out;
+}
+
+bool dns_init(void) {
+  resolvers = workers_new(DNS_RESOLVER_THREADS);
+  return resolvers != NULL;
+}
+
+bool dns_cache_lookup(const char *host, uint16_t port,
+                      struct sockaddr_storage *addr, socklen_t *addr_len,
+                      int *domain) {
+  struct dns_query *refresh = NULL;
+  bool hit = false;
+
+  pthread_mutex_lock(&dns_mutex);
+  struct dns_entry *e = cache_find(host);
+  time_t t = now();
+  if (e != NULL && e->expires > t) {
+    hit = true;
+    e->hits++;
+    lru_unlink(e);
+    lru_push(e);
+
+    memset(addr, 0, sizeof(*addr));
+    memcpy(addr, &e->addr, e->addr_len);
+    *addr_len = e->addr_len;
+    *domain = e->domain;
+    set_port(addr, port);
+
+    dns_cache_hit();
+    if (e->refreshed) {
+      dns_refresh_hit();
+    }
+
+    // Entrada caliente por vencer: la renovamos en segundo plano para que
+    // los próximos pedidos no paguen la resolución
+    if (!e->refreshing && e->hits >= DNS_REFRESH_MIN_HITS &&
+        e->expires - t <= DNS_REFRESH_WINDOW &&
+        refreshes < DNS_MAX_REFRESHES) {
+      bool pending = false;
+      for (struct dns_query *q = inflight; q != NULL; q = q->next) {
+        if (strcasecmp(q->host, host) == 0) {
+          pending = true;
+          break;
+        }
+      }
+      if (!pending) {
+        refresh = query_new(host, true);
+        if (refresh != NULL) {
+          e->refreshing = true;
+          refreshes++;
+          dns_refresh_started();
+        }
+      }
+    }
+  } else {
+    dns_cache_miss();
+  }
+  pthread_mutex_unlock(&dns_mutex);
+
+  if (refresh != NULL) {
+    query_launch(refresh);
+  }
+
+  return hit;
+}
+
+struct dns_query *dns_query_start(fd_selector s, int fd, const char *host) {
+  struct dns_waiter *w = malloc(sizeof(*w));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->s = s;
+  w->fd = fd;
+
+  bool owner = false;
+  pthread_mutex_lock(&dns_mutex);
+  struct dns_query *q = inflight;
+  while (q != NULL && strcasecmp(q->host, host) != 0) {
+    q = q->next;
+  }
+  if (q == NULL) {
+    q = query_new(host, false);
+    if (q == NULL) {
+      pthread_mutex_unlock(&dns_mutex);
+      free(w);
+      return NULL;
+    }
+    owner = true;
+  } else {
+    printf("DNS: joining in-flight lookup for %s (fd %d)\n", host, fd);
+  }
+  q->references++;
+  w->next = q->waiters;
+  q->waiters = w;
+  pthread_mutex_unlock(&dns_mutex);
+
+  if (owner) {
+    query_launch(q);
+  }
+
+  return q;
+}
+
+bool dns_query_result(struct dns_query *q, uint16_t port,
+                      struct sockaddr_storage *addr, socklen_t *addr_len,
+                      int *domain) {
+  bool ret = false;
+
+  pthread_mutex_lock(&dns_mutex);
+  if (q->done && q->resolved) {
+    memset(addr, 0, sizeof(*addr));
+    memcpy(addr, &q->addr, q->addr_len);
+    *addr_len = q->addr_len;
+    *domain = q->domain;
+    set_port(addr, port);
+    ret = true;
+  }
+  pthread_mutex_unlock(&dns_mutex);
+
+  return ret;
+}
+
+bool dns_query_done(struct dns_query *q) {
+  pthread_mutex_lock(&dns_mutex);
+  bool ret = q->done;
+  pthread_mutex_unlock(&dns_mutex);
+  return ret;
+}
+
+void dns_query_cancel(struct dns_query *q, int fd) {
+  if (q == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dns_mutex);
+  // Si la respuesta ya llegó la lista de suscriptores está vacía y sólo queda
+  // soltar la referencia
+  struct dns_waiter **it = &q->waiters;
+  while (*it != NULL) {
+    if ((*it)->fd == fd) {
+      struct dns_waiter *aux = *it;
+      *it = aux->next;
+      free(aux);
+      break;
+    }
+    it = &(*it)->next;
+  }
+  query_unref(q);
+  pthread_mutex_unlock(&dns_mutex);
+}
+
+void dns_query_release(struct dns_query *q) {
+  if (q == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dns_mutex);
+  query_unref(q);
+  pthread_mutex_unlock(&dns_mutex);
+}
@@ -4,7 +4,97 @@
 #include "../lib/selector.h"
 #include <netdb.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
 
-void * dns_resolve(void* s_key);
+/**
+ * dns.c - resolución de nombres fuera del hilo del selector
+ *
+ * Las consultas en vuelo se comparten por nombre: la primera sesión que pide
+ * un host es dueña de la resolución (lanza el hilo que llama a getaddrinfo),
+ * y las sesiones que piden el mismo host mientras la consulta no terminó se
+ * suscriben a ella. Cuando llega la respuesta se notifica a cada suscriptor
+ * mediante `selector_notify_block'.
+ *
+ * Las respuestas se guardan en una caché con vencimiento. Las entradas que se
+ * siguen pidiendo cerca de vencer se renuevan en segundo plano (con un tope
+ * de refrescos simultáneos), así los destinos más usados no esperan una
+ * resolución en el camino del request.
+ *
+ * Las resoluciones corren en un pool de hilos de tamaño fijo. Cerrar una
+ * sesión cancela su suscripción (`dns_query_cancel'): la consulta no vuelve a
+ * tocar la sesión, y si queda sin interesados antes de salir de la cola se
+ * descarta sin llamar a getaddrinfo.
+ *
+ * Antes de todo eso, los literales IPv4/IPv6 enviados como ATYP_DOMAIN y los
+ * nombres de la tabla estática de hosts (configurable por gestión) se
+ * resuelven en el momento sin pasar por el resolvedor.
+ */
+struct dns_query;
 
-#endif
\ No newline at end of file
+/** levanta el pool resolvedor. Retorna false ante error */
+bool dns_init(void);
+
+/**
+ * Resuelve sin bloquear `host' si es un literal IPv4/IPv6 ("10.1.2.3",
+ * "::1" o "[::1]") o si está en la tabla estática de hosts. Copia la dirección
+ * en `addr' con el puerto `port' (en host byte order).
+ */
+bool dns_static_lookup(const char *host, uint16_t port,
+                       struct sockaddr_storage *addr, socklen_t *addr_len,
+                       int *domain);
+
+/**
+ * Agrega (o reemplaza) un host en la tabla estática. `addrs' es una lista de
+ * literales IP separados por comas; con más de una se entregan en round-robin.
+ */
+bool dns_hosts_add(const char *host, const char *addrs);
+
+/** quita un host de la tabla estática */
+bool dns_hosts_del(const char *host);
+
+/**
+ * Lista la tabla estática, una línea `host=addr[,addr...]' por host.
+ * El caller es responsable de liberar la memoria (free).
+ */
+char *dns_hosts_list(void);
+
+/**
+ * Busca `host' en la caché. Si hay una respuesta vigente la copia en `addr'
+ * con el puerto `port' (en host byte order) y retorna true; si además la
+ * entrada está caliente y por vencer dispara su refresco.
+ */
+bool dns_cache_lookup(const char *host, uint16_t port,
+                      struct sockaddr_storage *addr, socklen_t *addr_len,
+                      int *domain);
+
+/**
+ * Inicia la resolución de `host' o se suscribe a una en vuelo. Al terminar se
+ * notifica `fd' en el selector `s'.
+ *
+ * Retorna NULL si no hay memoria.
+ */
+struct dns_query *dns_query_start(fd_selector s, int fd, const char *host);
+
+/**
+ * Copia la primera dirección resuelta en `addr' con el puerto `port' (en
+ * host byte order). Retorna false si el nombre no pudo resolverse.
+ */
+bool dns_query_result(struct dns_query *q, uint16_t port,
+                      struct sockaddr_storage *addr, socklen_t *addr_len,
+                      int *domain);
+
+/** indica si la consulta ya tiene respuesta (o falló) */
+bool dns_query_done(struct dns_query *q);
+
+/**
+ * cancela la suscripción de `fd' (la sesión se cierra antes de la respuesta)
+ * y suelta su referencia. Tolera NULL.
+ */
+void dns_query_cancel(struct dns_query *q, int fd);
+
+/** libera la referencia de la sesión sobre la consulta ya respondida */
+void dns_query_release(struct dns_query *q);
+
+#endif
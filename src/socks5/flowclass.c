@@ -0,0 +1,63 @@
+#include <time.h>
+
+#include "flowclass.h"
+
+/** duración de la ventana de medición */
+#define FLOW_WINDOW_MS 200
+/** por encima de esta tasa la sesión pasa a masiva... */
+#define FLOW_BULK_RATE (128 * 1024)
+/** ...y vuelve a interactiva por debajo de esta */
+#define FLOW_INTERACTIVE_RATE (32 * 1024)
+/** lecturas medias mayores no son de un flujo interactivo */
+#define FLOW_INTERACTIVE_READ 1024
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void flow_init(struct flow_profile *f) {
+  f->class = FLOW_INTERACTIVE;
+  f->window_start = monotonic_ns();
+  f->window_bytes = 0;
+  f->window_reads = 0;
+}
+
+bool flow_observe(struct flow_profile *f, size_t n) {
+  f->window_bytes += n;
+  f->window_reads++;
+
+  uint64_t now = monotonic_ns();
+  uint64_t elapsed = now - f->window_start;
+  if (elapsed < FLOW_WINDOW_MS * 1000000ULL) {
+    return false;
+  }
+
+  // tras un silencio largo la ventana es larga y la tasa baja: una descarga
+  // que se detuvo y pasa a tráfico interactivo vuelve a la vía rápida
+  uint64_t rate = f->window_bytes * 1000000000ULL / elapsed;
+  uint64_t avg_read = f->window_bytes / f->window_reads;
+  enum flow_class next = f->class;
+  if (f->class == FLOW_INTERACTIVE) {
+    if (rate > FLOW_BULK_RATE || avg_read > FLOW_INTERACTIVE_READ) {
+      next = FLOW_BULK;
+    }
+  } else if (rate < FLOW_INTERACTIVE_RATE &&
+             avg_read <= FLOW_INTERACTIVE_READ) {
+    next = FLOW_INTERACTIVE;
+  }
+
+  f->window_start = now;
+  f->window_bytes = 0;
+  f->window_reads = 0;
+  if (next == f->class) {
+    return false;
+  }
+  f->class = next;
+  return true;
+}
+
+const char *flow_class_name(enum flow_class class) {
+  return class == FLOW_BULK ? "bulk" : "interactive";
+}
@@ -0,0 +1,42 @@
+#ifndef FLOWCLASS_H
+#define FLOWCLASS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * flowclass.c - clasificación de sesiones en COPY
+ *
+ * Cada sesión se clasifica por lo que movió en la última ventana: tasa de
+ * bytes y tamaño medio de lectura. Un flujo interactivo (una terminal SSH,
+ * un chat) mueve pocos bytes en lecturas chicas; uno masivo (una descarga)
+ * llena el buffer en cada lectura. La clasificación tiene histéresis para
+ * no oscilar, y toda sesión empieza como interactiva: las cortas terminan
+ * antes de que valga la pena tratarlas como masivas.
+ */
+enum flow_class {
+  FLOW_INTERACTIVE,
+  FLOW_BULK,
+};
+
+struct flow_profile {
+  enum flow_class class;
+  /** comienzo de la ventana en curso (ns de CLOCK_MONOTONIC) */
+  uint64_t window_start;
+  uint64_t window_bytes;
+  unsigned window_reads;
+};
+
+/** arranca la clasificación (la sesión entra a COPY) */
+void flow_init(struct flow_profile *f);
+
+/**
+ * Registra una lectura de `n' bytes. Retorna true si con ella cerró una
+ * ventana y la sesión cambió de clase.
+ */
+bool flow_observe(struct flow_profile *f, size_t n);
+
+const char *flow_class_name(enum flow_class class);
+
+#endif
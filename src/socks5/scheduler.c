@@ -0,0 +1,183 @@
+#include <time.h>
+
+#include "scheduler.h"
+
+/** duración de una ronda mientras haya sesiones estacionadas */
+#define SCHED_ROUND_MS 5
+/** el bucket global acumula a lo sumo esta ventana de capacidad */
+#define SCHED_BURST_MS 20
+/** cupo mínimo por unidad de peso en una ronda, para no fragmentar */
+#define SCHED_MIN_QUANTUM 1500
+/** una sesión no acumula déficit por más de estas rondas */
+#define SCHED_MAX_ROUNDS 2
+
+static uint64_t capacity = 0;
+static int64_t tokens = 0;
+static uint64_t last_refill = 0;
+
+/** estacionadas: las interactivas adelante, el resto por orden de llegada */
+static struct sched_entry *head = NULL, *tail = NULL;
+/** true desde que alguien se estaciona hasta una ronda sin estacionados */
+static bool contended = false;
+static unsigned long round_timer = 0;
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int64_t burst(void) {
+  int64_t b = capacity * SCHED_BURST_MS / 1000;
+  return b < SCHED_MIN_QUANTUM ? SCHED_MIN_QUANTUM : b;
+}
+
+static void refill(uint64_t now) {
+  if (now > last_refill) {
+    double added = (double)capacity * (now - last_refill) / 1e9;
+    int64_t max = burst();
+    tokens = added >= (double)(max - tokens) ? max : tokens + (int64_t)added;
+  }
+  last_refill = now;
+}
+
+void sched_set_capacity(uint64_t bytes_per_sec) {
+  capacity = bytes_per_sec;
+  last_refill = monotonic_ns();
+  tokens = capacity == 0 ? 0 : burst();
+  // las estacionadas se liberan en la próxima ronda
+}
+
+uint64_t sched_get_capacity(void) { return capacity; }
+
+size_t sched_allowance(struct sched_entry *e, size_t want) {
+  if (capacity == 0) {
+    return want;
+  }
+  refill(monotonic_ns());
+  // en modo contendido manda el déficit: la ronda ya repartió los tokens, y
+  // si miráramos el bucket las primeras en leer dejarían sin nada al resto
+  int64_t max = contended ? e->deficit : tokens;
+  // con menos que una lectura útil esperamos la ronda: leer de a pocos bytes
+  // lo que se repuso desde la última llamada sólo quema CPU
+  int64_t min = want < SCHED_MIN_QUANTUM ? (int64_t)want : SCHED_MIN_QUANTUM;
+  if (max < min || max <= 0) {
+    return 0;
+  }
+  return (uint64_t)max < want ? (size_t)max : want;
+}
+
+void sched_charge(struct sched_entry *e, size_t n) {
+  if (capacity == 0) {
+    return;
+  }
+  tokens -= n;
+  if (contended) {
+    e->deficit -= n;
+    if (e->deficit < 0) {
+      e->deficit = 0;
+    }
+  }
+}
+
+static void unlink_entry(struct sched_entry *e) {
+  if (e->prev != NULL) {
+    e->prev->next = e->next;
+  } else {
+    head = e->next;
+  }
+  if (e->next != NULL) {
+    e->next->prev = e->prev;
+  } else {
+    tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+  e->parked = false;
+}
+
+static void round_tick(fd_selector s, void *data);
+
+void sched_park(struct sched_entry *e, fd_selector s) {
+  if (e->parked) {
+    return;
+  }
+  e->parked = true;
+  if (e->interactive) {
+    // adelante: leen antes que las masivas al despertar
+    e->prev = NULL;
+    e->next = head;
+    if (head != NULL) {
+      head->prev = e;
+    } else {
+      tail = e;
+    }
+    head = e;
+  } else {
+    e->next = NULL;
+    e->prev = tail;
+    if (tail != NULL) {
+      tail->next = e;
+    } else {
+      head = e;
+    }
+    tail = e;
+  }
+
+  contended = true;
+  if (round_timer == 0) {
+    round_timer = selector_timer_add(s, SCHED_ROUND_MS, round_tick, NULL);
+  }
+}
+
+void sched_remove(struct sched_entry *e) {
+  if (e->parked) {
+    unlink_entry(e);
+  }
+}
+
+static void round_tick(fd_selector s, void *data) {
+  (void)data;
+  round_timer = 0;
+
+  if (head == NULL) {
+    // nadie se quedó sin cupo en toda la ronda
+    contended = false;
+    return;
+  }
+  if (capacity != 0) {
+    refill(monotonic_ns());
+    if (tokens < SCHED_MIN_QUANTUM) {
+      round_timer = selector_timer_add(s, SCHED_ROUND_MS, round_tick, NULL);
+      return;
+    }
+  }
+
+  // Repartimos lo disponible en proporción al peso
+  uint64_t total_weight = 0;
+  for (struct sched_entry *e = head; e != NULL; e = e->next) {
+    total_weight += e->weight == 0 ? 1 : e->weight;
+  }
+  int64_t quantum = capacity == 0 ? 0 : tokens / (int64_t)total_weight;
+  if (quantum < SCHED_MIN_QUANTUM) {
+    quantum = SCHED_MIN_QUANTUM;
+  }
+
+  // desenganchamos antes de despertar: las sesiones pueden reestacionarse
+  struct sched_entry *e = head;
+  head = tail = NULL;
+  while (e != NULL) {
+    struct sched_entry *next = e->next;
+    int64_t grant = quantum * (e->weight == 0 ? 1 : e->weight);
+    e->deficit += grant;
+    if (e->deficit > grant * SCHED_MAX_ROUNDS) {
+      e->deficit = grant * SCHED_MAX_ROUNDS;
+    }
+    e->prev = e->next = NULL;
+    e->parked = false;
+    e->resume(e, s);
+    e = next;
+  }
+
+  // seguimos en modo contendido hasta una ronda sin estacionados
+  round_timer = selector_timer_add(s, SCHED_ROUND_MS, round_tick, NULL);
+}
@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "../lib/selector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * scheduler.c - reparto de la capacidad de salida entre sesiones
+ *
+ * Con una capacidad configurada (bytes por segundo, sumando todas las
+ * sesiones en COPY) las lecturas de la copia se cobran a un bucket global.
+ * Mientras sobre capacidad cada sesión lee lo que quiera. Cuando se agota el
+ * sistema pasa a modo contendido y se reparte por deficit round-robin: las
+ * sesiones que quieren leer se estacionan, y en cada ronda (un timer del
+ * selector) los bytes repuestos se dividen entre las estacionadas en
+ * proporción a su peso y se suman a su déficit. Cada sesión lee a lo sumo su
+ * déficit por ronda, así una descarga larga no puede monopolizar la salida ni
+ * sumarle latencia a una sesión que mueve pocos bytes.
+ *
+ * Sin capacidad configurada (0) no hay scheduling.
+ *
+ * Sólo desde el hilo del selector.
+ */
+
+/** estado de scheduling de una sesión. Se embebe en la sesión */
+struct sched_entry {
+  /** corre al terminar la ronda que le asignó cupo a la sesión */
+  void (*resume)(struct sched_entry *e, fd_selector s);
+  struct sched_entry *prev, *next;
+  bool parked;
+  /** bytes que puede mover en modo contendido */
+  int64_t deficit;
+  /** peso de la sesión en el reparto (>= 1) */
+  unsigned weight;
+  /** las interactivas se despiertan primero en cada ronda */
+  bool interactive;
+};
+
+/** capacidad de salida en bytes por segundo (0 = sin límite) */
+void sched_set_capacity(uint64_t bytes_per_sec);
+uint64_t sched_get_capacity(void);
+
+/**
+ * Cuántos de `want' bytes puede leer ahora la sesión (0 = tiene que
+ * estacionarse con `sched_park').
+ */
+size_t sched_allowance(struct sched_entry *e, size_t want);
+
+/** descuenta `n' bytes leídos */
+void sched_charge(struct sched_entry *e, size_t n);
+
+/** estaciona `e' hasta la próxima ronda */
+void sched_park(struct sched_entry *e, fd_selector s);
+
+/** saca a `e' del scheduler (la sesión se cierra) */
+void sched_remove(struct sched_entry *e);
+
+#endif
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "lib/netutils.h"
+#include "management/metrics.h"
+#include "sessions.h"
+#include "socks5.h"
+#include "topk.h"
+
+/** lo más que ocupa una línea del listado, sin el usuario ni el destino */
+#define LINE_FIXED 320
+
+static client_t *first = NULL;
+static client_t *last = NULL;
+static uint64_t next_id = 1;
+
+/** nombres de los estados en el listado y en los filtros */
+static const char *state_names[] = {
+    [HELLO_READ] = "hello_read",
+    [HELLO_WRITE] = "hello_write",
+    [AUTH_READ] = "auth_read",
+    [AUTH_VERIFY] = "auth_verify",
+    [AUTH_WRITE] = "auth_write",
+    [REQUEST_READ] = "request_read",
+    [REQUEST_RESOLVE] = "request_resolve",
+    [REQUEST_CONNECT] = "request_connect",
+    [REQUEST_WRITE] = "request_write",
+    [COPY] = "copy",
+    [DONE] = "done",
+    [ERROR] = "error",
+};
+
+/** un gauge por estado no terminal; los terminales duran hasta el cierre */
+static const char *gauge_names[] = {
+    [HELLO_READ] = "sessions in hello_read",
+    [HELLO_WRITE] = "sessions in hello_write",
+    [AUTH_READ] = "sessions in auth_read",
+    [AUTH_VERIFY] = "sessions in auth_verify",
+    [AUTH_WRITE] = "sessions in auth_write",
+    [REQUEST_READ] = "sessions in request_read",
+    [REQUEST_RESOLVE] = "sessions in request_resolve",
+    [REQUEST_CONNECT] = "sessions in request_connect",
+    [REQUEST_WRITE] = "sessions in request_write",
+    [COPY] = "sessions in copy",
+};
+
+static metric_id state_gauges[DONE];
+static metric_id killed_sessions = METRIC_INVALID;
+
+void sessions_init(void) {
+  for (unsigned i = 0; i < DONE; i++) {
+    state_gauges[i] = metrics_register_level(gauge_names[i]);
+  }
+  killed_sessions = metrics_register_counter("killed sessions");
+}
+
+static void count(unsigned state, bool enter) {
+  if (state < DONE) {
+    if (enter) {
+      metrics_add(state_gauges[state], 1);
+    } else {
+      metrics_sub(state_gauges[state], 1);
+    }
+  }
+}
+
+void sessions_add(client_t *s) {
+  s->id = next_id++;
+  s->census_state = HELLO_READ;
+  s->prev_session = last;
+  s->next_session = NULL;
+  if (last != NULL) {
+    last->next_session = s;
+  } else {
+    first = s;
+  }
+  last = s;
+  count(HELLO_READ, true);
+}
+
+void sessions_remove(client_t *s) {
+  if (s->prev_session != NULL) {
+    s->prev_session->next_session = s->next_session;
+  } else {
+    first = s->next_session;
+  }
+  if (s->next_session != NULL) {
+    s->next_session->prev_session = s->prev_session;
+  } else {
+    last = s->prev_session;
+  }
+  count(s->census_state, false);
+}
+
+void sessions_transition(client_t *s, unsigned state) {
+  if (state != s->census_state) {
+    count(s->census_state, false);
+    count(state, true);
+    s->census_state = state;
+  }
+}
+
+static int state_by_name(const char *name) {
+  for (unsigned i = 0; i <= ERROR; i++) {
+    if (strcasecmp(name, state_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool parse_number(const char *s, uint64_t *out) {
+  char *end;
+  if (*s < '0' || *s > '9') {
+    return false;
+  }
+  unsigned long long n = strtoull(s, &end, 10);
+  *out = n;
+  return *end == '\0';
+}
+
+bool sessions_parse_filter(const char *arg, struct session_filter *f) {
+  memset(f, 0, sizeof(*f));
+  f->state = -1;
+  f->limit = SESSIONS_PAGE_MAX;
+
+  char copy[256];
+  strncpy(copy, arg, sizeof(copy) - 1);
+  copy[sizeof(copy) - 1] = '\0';
+
+  char *saveptr;
+  for (char *tok = strtok_r(copy, " ", &saveptr); tok != NULL;
+       tok = strtok_r(NULL, " ", &saveptr)) {
+    char *value = strchr(tok, '=');
+    if (value == NULL || value[1] == '\0') {
+      return false;
+    }
+    *value++ = '\0';
+    uint64_t n;
+    if (strcasecmp(tok, "user") == 0) {
+      strncpy(f->user, value, sizeof(f->user) - 1);
+    } else if (strcasecmp(tok, "state") == 0) {
+      if ((f->state = state_by_name(value)) < 0) {
+        return false;
+      }
+    } else if (strcasecmp(tok, "age") == 0) {
+      if (!parse_number(value, &f->min_age)) {
+        return false;
+      }
+    } else if (strcasecmp(tok, "bytes") == 0) {
+      if (!parse_number(value, &f->min_bytes)) {
+        return false;
+      }
+    } else if (strcasecmp(tok, "after") == 0) {
+      if (!parse_number(value, &f->after)) {
+        return false;
+      }
+    } else if (strcasecmp(tok, "limit") == 0) {
+      if (!parse_number(value, &n) || n < 1 || n > SESSIONS_PAGE_MAX) {
+        return false;
+      }
+      f->limit = n;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Usuario con el que se cobra la sesión: el autenticado o el de la red de
+// confianza, recién cuando la cuenta quedó asignada
+static const char *session_user(const client_t *s) {
+  return s->account != NULL ? s->credentials.username : "-";
+}
+
+static bool matches(const client_t *s, const struct session_filter *f,
+                    uint64_t now) {
+  return s->id > f->after &&
+         (f->user[0] == '\0' || strcmp(f->user, session_user(s)) == 0) &&
+         (f->state < 0 || (unsigned)f->state == s->census_state) &&
+         (now - s->accepted_at) / 1000000 >= f->min_age &&
+         s->bytes_up + s->bytes_down >= f->min_bytes;
+}
+
+// El destino se conoce recién con el pedido parseado
+static bool has_destination(const client_t *s) {
+  return s->census_state == REQUEST_RESOLVE ||
+         s->census_state == REQUEST_CONNECT ||
+         s->census_state == REQUEST_WRITE || s->census_state == COPY ||
+         (s->census_state >= DONE && s->origin_fd >= 0);
+}
+
+char *sessions_list(const struct session_filter *f, size_t *matched) {
+  size_t size = f->limit * (LINE_FIXED + 256 + TOPK_KEY_MAX) + 1;
+  char *out = malloc(size);
+  if (out == NULL) {
+    return NULL;
+  }
+  out[0] = '\0';
+
+  uint64_t now = latency_clock();
+  size_t pos = 0, listed = 0;
+  *matched = 0;
+  for (client_t *s = first; s != NULL; s = s->next_session) {
+    if (!matches(s, f, now)) {
+      continue;
+    }
+    (*matched)++;
+    if (listed == f->limit) {
+      continue;
+    }
+    listed++;
+
+    char client[SOCKADDR_TO_HUMAN_MIN] = "-";
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(s->client_fd, (struct sockaddr *)&addr, &len) == 0) {
+      sockaddr_to_human(client, sizeof(client), (struct sockaddr *)&addr);
+    }
+    char destination[TOPK_KEY_MAX] = "-";
+    if (has_destination(s)) {
+      socks5_destination(s, destination, sizeof(destination));
+    }
+
+    // Formato: id user=u state=s age=seg up=bytes down=bytes recvs=n sends=n
+    // eagain=n interests=n client=c dest=d
+    pos += snprintf(out + pos, size - pos,
+                    "%llu user=%s state=%s age=%llu up=%llu down=%llu "
+                    "recvs=%llu sends=%llu eagain=%llu interests=%llu "
+                    "client=%s dest=%s\r\n",
+                    (unsigned long long)s->id, session_user(s),
+                    state_names[s->census_state],
+                    (unsigned long long)(now - s->accepted_at) / 1000000,
+                    (unsigned long long)s->bytes_up,
+                    (unsigned long long)s->bytes_down,
+                    (unsigned long long)s->syscalls.recvs,
+                    (unsigned long long)s->syscalls.sends,
+                    (unsigned long long)s->syscalls.eagains,
+                    (unsigned long long)s->syscalls.interests, client,
+                    destination);
+  }
+  return out;
+}
+
+bool sessions_kill(fd_selector selector, uint64_t id) {
+  client_t *s = first;
+  while (s != NULL && s->id != id) {
+    s = s->next_session;
+  }
+  if (s == NULL) {
+    return false;
+  }
+  // Igual que ante un error: al desregistrar el último fd se destruye la
+  // sesión, así que los dos se leen antes
+  int client_fd = s->client_fd;
+  int origin_fd = s->origin_fd;
+  printf("Killing session %llu (fd %d)\n", (unsigned long long)id,
+         client_fd);
+  metrics_add(killed_sessions, 1);
+  selector_unregister_fd(selector, client_fd);
+  if (origin_fd >= 0) {
+    selector_unregister_fd(selector, origin_fd);
+  }
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef SESSIONS_H
+#define SESSIONS_H
+
+#include "lib/selector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * sessions.c - registro de las sesiones SOCKS vivas
+ *
+ * Cada sesión se enlaza al aceptarse y se desenlaza al destruirse, con un
+ * id que no se reutiliza. El servidor avisa los cambios de estado de la
+ * máquina de estados y se mantiene un gauge por estado, así que saber
+ * cuántas sesiones hay en cada uno no requiere recorrerlas.
+ *
+ * El listado y el cierre forzado son para el protocolo de management:
+ * encontrar sesiones trabadas o abusivas y echarlas sin reiniciar.
+ *
+ * Sólo desde el hilo del selector.
+ */
+
+struct client_s;
+
+/** sesiones por página de LIST_SESSIONS, por defecto y como máximo */
+#define SESSIONS_PAGE_MAX 16
+
+/** registra los gauges por estado */
+void sessions_init(void);
+
+/** enlaza una sesión recién creada (en HELLO_READ) y le asigna el id.
+ * Desde ahí hasta la destrucción está en el registro */
+void sessions_add(struct client_s *s);
+/** la desenlaza al destruirla */
+void sessions_remove(struct client_s *s);
+/** la sesión pasó (o sigue) en `state' */
+void sessions_transition(struct client_s *s, unsigned state);
+
+/** criterios de LIST_SESSIONS; los que están en cero no filtran */
+struct session_filter {
+  char user[256];
+  int state;          // -1 para cualquiera
+  uint64_t min_age;   // segundos
+  uint64_t min_bytes; // en los dos sentidos
+  uint64_t after;     // sólo ids mayores: la página siguiente
+  unsigned limit;
+};
+
+/**
+ * Interpreta `arg' (`clave=valor' separados por espacios: user, state,
+ * age, bytes, after, limit). Retorna false si alguno es inválido.
+ */
+bool sessions_parse_filter(const char *arg, struct session_filter *f);
+
+/**
+ * Lista las sesiones que cumplen `f', de la más vieja a la más nueva,
+ * hasta f->limit. En `matched' deja cuántas cumplen en total (desde
+ * f->after). El caller libera el string.
+ */
+char *sessions_list(const struct session_filter *f, size_t *matched);
+
+/** cierra la sesión `id'. Retorna false si no existe */
+bool sessions_kill(fd_selector s, uint64_t id);
+
+#endif
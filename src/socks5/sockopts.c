@@ -0,0 +1,194 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sockopts.h"
+
+#define PROFILE_DEFAULTS                                                       \
+  {                                                                            \
+    .nodelay = SOCKOPT_DEFAULT, .rcvbuf = SOCKOPT_DEFAULT,                     \
+    .sndbuf = SOCKOPT_DEFAULT, .notsent_lowat = SOCKOPT_DEFAULT,               \
+    .quickack = SOCKOPT_DEFAULT, .keepalive = SOCKOPT_DEFAULT,                 \
+    .user_timeout = SOCKOPT_DEFAULT, .congestion = "",                         \
+  }
+
+static struct sock_profile profiles[] = {
+    [LEG_CLIENT] = PROFILE_DEFAULTS,
+    [LEG_ORIGIN] = PROFILE_DEFAULTS,
+};
+
+static const char *leg_names[] = {
+    [LEG_CLIENT] = "client",
+    [LEG_ORIGIN] = "origin",
+};
+
+/** opciones enteras: campo del perfil, nivel y nombre para setsockopt */
+static const struct {
+  const char *name;
+  size_t offset;
+  int level, optname;
+  /** valores válidos: [0, max] */
+  int max;
+} int_options[] = {
+    {"nodelay", offsetof(struct sock_profile, nodelay), IPPROTO_TCP,
+     TCP_NODELAY, 1},
+    {"rcvbuf", offsetof(struct sock_profile, rcvbuf), SOL_SOCKET, SO_RCVBUF,
+     INT_MAX / 2},
+    {"sndbuf", offsetof(struct sock_profile, sndbuf), SOL_SOCKET, SO_SNDBUF,
+     INT_MAX / 2},
+    {"notsent_lowat", offsetof(struct sock_profile, notsent_lowat),
+     IPPROTO_TCP, TCP_NOTSENT_LOWAT, INT_MAX},
+    {"quickack", offsetof(struct sock_profile, quickack), IPPROTO_TCP,
+     TCP_QUICKACK, 1},
+    {"keepalive", offsetof(struct sock_profile, keepalive), SOL_SOCKET,
+     SO_KEEPALIVE, 1},
+    {"user_timeout", offsetof(struct sock_profile, user_timeout), IPPROTO_TCP,
+     TCP_USER_TIMEOUT, INT_MAX},
+};
+
+#define N_INT_OPTIONS (sizeof(int_options) / sizeof(int_options[0]))
+
+static int *field(struct sock_profile *p, size_t i) {
+  return (int *)((char *)p + int_options[i].offset);
+}
+
+const struct sock_profile *sockopts_profile(enum sock_leg leg) {
+  return &profiles[leg];
+}
+
+void sockopts_apply(int fd, enum sock_leg leg) {
+  struct sock_profile *p = &profiles[leg];
+  for (size_t i = 0; i < N_INT_OPTIONS; i++) {
+    int value = *field(p, i);
+    if (value != SOCKOPT_DEFAULT) {
+      setsockopt(fd, int_options[i].level, int_options[i].optname, &value,
+                 sizeof(value));
+    }
+  }
+  if (p->congestion[0] != '\0') {
+    setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, p->congestion,
+               strlen(p->congestion));
+  }
+}
+
+void sockopts_rearm(int fd, enum sock_leg leg) {
+  int value = profiles[leg].quickack;
+  if (value != SOCKOPT_DEFAULT) {
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &value, sizeof(value));
+  }
+}
+
+// El kernel sólo acepta los algoritmos cargados (y, sin privilegios, los
+// permitidos): lo probamos en un socket descartable
+static bool congestion_available(const char *name) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name, strlen(name)) ==
+            0;
+  close(fd);
+  return ok;
+}
+
+sockopt_status sockopts_set(const char *spec) {
+  const char *colon = strchr(spec, ':');
+  const char *equals = colon == NULL ? NULL : strchr(colon, '=');
+  if (colon == NULL || equals == NULL || equals == colon + 1 ||
+      equals[1] == '\0') {
+    return SOCKOPT_FORMAT;
+  }
+  size_t leg_len = colon - spec, name_len = equals - colon - 1;
+  const char *name = colon + 1, *value = equals + 1;
+
+  int leg = -1;
+  for (size_t i = 0; i < sizeof(leg_names) / sizeof(leg_names[0]); i++) {
+    if (strlen(leg_names[i]) == leg_len &&
+        strncmp(spec, leg_names[i], leg_len) == 0) {
+      leg = i;
+    }
+  }
+  if (leg < 0) {
+    return SOCKOPT_UNKNOWN;
+  }
+  struct sock_profile *p = &profiles[leg];
+  bool reset = strcmp(value, "default") == 0;
+
+  if (name_len == strlen("congestion") &&
+      strncmp(name, "congestion", name_len) == 0) {
+    if (reset) {
+      p->congestion[0] = '\0';
+      return SOCKOPT_SUCCESS;
+    }
+    if (strlen(value) >= sizeof(p->congestion)) {
+      return SOCKOPT_VALUE;
+    }
+    for (const char *c = value; *c != '\0'; c++) {
+      if (!isalnum((unsigned char)*c) && *c != '_' && *c != '-') {
+        return SOCKOPT_VALUE;
+      }
+    }
+    if (!congestion_available(value)) {
+      return SOCKOPT_VALUE;
+    }
+    strcpy(p->congestion, value);
+    return SOCKOPT_SUCCESS;
+  }
+
+  for (size_t i = 0; i < N_INT_OPTIONS; i++) {
+    if (strlen(int_options[i].name) != name_len ||
+        strncmp(name, int_options[i].name, name_len) != 0) {
+      continue;
+    }
+    if (reset) {
+      *field(p, i) = SOCKOPT_DEFAULT;
+      return SOCKOPT_SUCCESS;
+    }
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (*end != '\0' || errno == ERANGE || n < 0 || n > int_options[i].max) {
+      return SOCKOPT_VALUE;
+    }
+    *field(p, i) = n;
+    return SOCKOPT_SUCCESS;
+  }
+  return SOCKOPT_UNKNOWN;
+}
+
+char *sockopts_list(void) {
+  size_t lines = (N_INT_OPTIONS + 1) * 2;
+  size_t size = lines * 48 + 1, pos = 0;
+  char *out = malloc(size);
+  if (out == NULL) {
+    return NULL;
+  }
+  out[0] = '\0';
+
+  // Formato: extremo:opción=valor\r\n
+  for (size_t leg = 0; leg < sizeof(leg_names) / sizeof(leg_names[0]); leg++) {
+    struct sock_profile *p = &profiles[leg];
+    for (size_t i = 0; i < N_INT_OPTIONS; i++) {
+      int value = *field(p, i);
+      if (value == SOCKOPT_DEFAULT) {
+        pos += snprintf(out + pos, size - pos, "%s:%s=default\r\n",
+                        leg_names[leg], int_options[i].name);
+      } else {
+        pos += snprintf(out + pos, size - pos, "%s:%s=%d\r\n", leg_names[leg],
+                        int_options[i].name, value);
+      }
+    }
+    pos += snprintf(out + pos, size - pos, "%s:congestion=%s\r\n",
+                    leg_names[leg],
+                    p->congestion[0] == '\0' ? "default" : p->congestion);
+  }
+  return out;
+}
@@ -0,0 +1,69 @@
+#ifndef SOCKOPTS_H
+#define SOCKOPTS_H
+
+#include <stdbool.h>
+
+/**
+ * sockopts.c - perfiles de opciones de socket por extremo
+ *
+ * Hay un perfil para los sockets aceptados de los clientes y otro para los
+ * sockets hacia los orígenes. Se aplican al crear cada socket (al aceptar,
+ * y antes del connect para que los buffers entren en el window scaling), así
+ * que un cambio afecta a las conexiones nuevas.
+ *
+ * Una opción sin valor (`default') deja la del kernel. TCP_NODELAY y
+ * TCP_NOTSENT_LOWAT en `default' quedan a cargo de la clasificación de
+ * sesiones (ver flowclass.h); con un valor fijo el perfil manda.
+ *
+ * TCP_QUICKACK no es persistente: el kernel vuelve a su modo de ACKs según
+ * el tráfico, así que la etapa de copia lo reaplica después de cada lectura
+ * (sockopts_rearm).
+ *
+ * Sólo desde el hilo del selector.
+ */
+enum sock_leg {
+  LEG_CLIENT,
+  LEG_ORIGIN,
+};
+
+/** valor de una opción sin configurar */
+#define SOCKOPT_DEFAULT (-1)
+
+struct sock_profile {
+  int nodelay;
+  int rcvbuf;
+  int sndbuf;
+  int notsent_lowat;
+  int quickack;
+  int keepalive;
+  /** milisegundos */
+  int user_timeout;
+  /** algoritmo de control de congestión, "" = el del sistema */
+  char congestion[16];
+};
+
+const struct sock_profile *sockopts_profile(enum sock_leg leg);
+
+/** aplica el perfil de `leg' a `fd'. Las opciones que fallan se ignoran */
+void sockopts_apply(int fd, enum sock_leg leg);
+
+/** reaplica a `fd' el quickack del perfil de `leg', si está fijado */
+void sockopts_rearm(int fd, enum sock_leg leg);
+
+typedef enum {
+  SOCKOPT_SUCCESS,
+  /** no es `<extremo>:<opción>=<valor>' */
+  SOCKOPT_FORMAT,
+  /** extremo u opción desconocidos */
+  SOCKOPT_UNKNOWN,
+  /** valor fuera de rango, o algoritmo de congestión no disponible */
+  SOCKOPT_VALUE,
+} sockopt_status;
+
+/** cambia una opción a partir de `<client|origin>:<opción>=<valor>' */
+sockopt_status sockopts_set(const char *spec);
+
+/** listado `<extremo>:<opción>=<valor>' de ambos perfiles. El caller libera */
+char *sockopts_list(void);
+
+#endif
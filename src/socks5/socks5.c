@@ -1,18 +1,27 @@
+#define _DEFAULT_SOURCE // struct tcp_info
+#include "admission.h"
 #include "args.h"
+#include "destinations.h"
 #include "dns.h"
 #include "lib/netutils.h"
 #include "management/logger.h"
 #include "management/metrics.h"
 #include "management/mng_users.h"
 #include "parsers/request.h"
+#include "socks5/sockopts.h"
 #include "selector.h"
 #include "stm.h"
+#include "topk.h"
+#include "uniques.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <hello.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <server.h>
 #include <socks5.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,14 +30,20 @@
 static unsigned on_hello_write(struct selector_key *key);
 static unsigned on_hello_read(struct selector_key *key);
 static unsigned on_auth_read(struct selector_key *key);
+static unsigned auth_process(struct selector_key *key);
+static unsigned request_process(struct selector_key *key);
+static unsigned on_auth_verify(struct selector_key *key);
 static unsigned on_auth_write(struct selector_key *key);
-static void on_request(const unsigned state, struct selector_key *key);
+static unsigned request_start(struct selector_key *key);
 static unsigned on_request_read(struct selector_key *key);
 static unsigned on_request_write(struct selector_key *key);
 static unsigned copy_write(struct selector_key *key);
 static unsigned copy_read(struct selector_key *key);
+static void copy_init(const unsigned state, struct selector_key *key);
 static unsigned request_connect_done(struct selector_key *key);
 static unsigned on_request_resolve(struct selector_key *key);
+static void copy_resume(struct account_waiter *w, fd_selector sel);
+static void copy_sched_resume(struct sched_entry *e, fd_selector sel);
 extern const struct fd_handler *get_session_handler();
 
 extern const struct fd_handler session_handlers;
@@ -37,13 +52,14 @@ static const struct state_definition socks5_states[] = {
     [HELLO_READ] = {.state = HELLO_READ, .on_read_ready = on_hello_read},
     [HELLO_WRITE] = {.state = HELLO_WRITE, .on_write_ready = on_hello_write},
     [AUTH_READ] = {.state = AUTH_READ, .on_read_ready = on_auth_read},
+    [AUTH_VERIFY] = {.state = AUTH_VERIFY, .on_block_ready = on_auth_verify},
     [AUTH_WRITE] = {.state = AUTH_WRITE, .on_write_ready = on_auth_write},
     [REQUEST_READ] = {.state = REQUEST_READ,
-                      .on_arrival = on_request,
                       .on_read_ready = on_request_read},
     [REQUEST_WRITE] = {.state = REQUEST_WRITE,
                        .on_write_ready = on_request_write},
     [COPY] = {.state = COPY,
+              .on_arrival = copy_init,
               .on_read_ready = copy_read,
               .on_write_ready = copy_write},
     [REQUEST_CONNECT] = {.state = REQUEST_CONNECT,
@@ -55,23 +71,30 @@ static const struct state_definition socks5_states[] = {
     [ERROR] = {.state = ERROR},
 };
 
+/** los bytes de cada sesión se suman a su destino de a tandas */
+#define DEST_FLUSH_BYTES (64 * 1024)
+
 void socks5_init(client_t *s) {
   s->stm.initial = HELLO_READ;
   s->stm.max_state = ERROR;
   s->stm.states = socks5_states;
   s->stm.current = NULL;
   stm_init(&s->stm);
+  s->throttle.resume = copy_resume;
+  s->sched.resume = copy_sched_resume;
 }
 
-static void on_request(const unsigned state, struct selector_key *key) {
-  (void)state;
+// Entrada a REQUEST_READ. Un cliente optimista manda el pedido (y hasta sus
+// primeros datos) sin esperar nuestras respuestas: si ya está en el buffer lo
+// procesamos sin esperar otra lectura
+static unsigned request_start(struct selector_key *key) {
   client_t *s = key->data;
   request_parser_init(&s->request_parser);
   selector_set_interest_key(key, OP_READ);
-}
-
-static bool validate_credentials(client_t *s) {
-  return check_credentials(s->credentials.username, s->credentials.password);
+  if (buffer_can_read(&s->read_buffer)) {
+    return request_process(key);
+  }
+  return REQUEST_READ;
 }
 
 // HELLO READ: Recibe datos del cliente y alimenta al parser
@@ -100,12 +123,18 @@ static unsigned on_hello_read(struct selector_key *key) {
   enum hello_state state =
       hello_consume(&session->read_buffer, &session->hello_parser, &errored);
   if (hello_is_done(state, 0)) {
+    latency_record(LATENCY_HELLO, session->accepted_at);
     // termino el handshake - elegimos el método de autenticación
     uint8_t method =
         SOCKS_HELLO_NO_ACCEPTABLE_METHODS; // Por defecto rechazamos
 
-    // Priorizamos autenticación con usuario/contraseña si está disponible
-    if (session->hello_parser.supports_userpass) {
+    // Las redes de confianza se saltean RFC 1929 si el cliente lo permite;
+    // si no, priorizamos autenticación con usuario/contraseña
+    if (session->trusted != NULL && session->hello_parser.supports_no_auth &&
+        accounts_acquire(session->trusted, &session->account)) {
+      method = SOCKS_HELLO_NOAUTHENTICATION_REQUIRED;
+      strcpy(session->credentials.username, session->trusted);
+    } else if (session->hello_parser.supports_userpass) {
       method = SOCKS_HELLO_USERPASS_AUTH;
     } else if (session->hello_parser.supports_no_auth) {
       // Solo aceptamos sin auth si no hay usuarios configurados
@@ -162,21 +191,45 @@ static unsigned on_hello_write(struct selector_key *key) {
     auth_parser_init(&session->auth_parser);
 
     // Cambiar a lectura para recibir credenciales
-    selector_set_interest(key->s, key->fd, OP_READ); 
+    selector_set_interest(key->s, key->fd, OP_READ);
+    if (buffer_can_read(&session->read_buffer)) {
+      return auth_process(key);
+    }
     return AUTH_READ;
   } else if (session->chosen_method == SOCKS_HELLO_NOAUTHENTICATION_REQUIRED) {
     // Sin autenticación, pasamos directo a REQUEST
-    selector_set_interest(key->s, key->fd, OP_READ);
-    return REQUEST_READ;
+    return request_start(key);
   } else {
     // 0xFF o método no soportado - cerramos conexión
     return ERROR;
   }
 }
 
+// Guarda el resultado de la autenticación y envía la respuesta
+static unsigned auth_reply(struct selector_key *key, bool success) {
+  client_t *s = key->data;
+  // Las credenciales son válidas pero el usuario puede estar en su tope de
+  // sesiones simultáneas
+  if (success && !accounts_acquire(s->credentials.username, &s->account)) {
+    printf("Session limit reached for user '%s'\n", s->credentials.username);
+    success = false;
+  }
+  latency_record(LATENCY_AUTH, s->phase_at);
+  s->auth_success = success;
+  uint8_t status = s->auth_success ? AUTH_SUCCESS : AUTH_FAILURE;
+
+  printf("Auth for fd %d: user='%s' -> %s\n", key->fd,
+         s->credentials.username, s->auth_success ? "SUCCESS" : "FAILURE");
+
+  // Preparar respuesta
+  if (-1 == auth_marshall(&s->write_buffer, status))
+    return ERROR;
+
+  return on_auth_write(key);
+}
+
 static unsigned on_auth_read(struct selector_key *key) {
   client_t *s = key->data;
-  bool errored = false;
 
   // 1. Leer del socket
   size_t nbyte;
@@ -193,28 +246,61 @@ static unsigned on_auth_read(struct selector_key *key) {
   }
   buffer_write_adv(&s->read_buffer, ret);
 
+  return auth_process(key);
+}
+
+// Parsea las credenciales que haya en el buffer. Se llama también al entrar a
+// AUTH_READ, por si el cliente las mandó junto con el saludo
+static unsigned auth_process(struct selector_key *key) {
+  client_t *s = key->data;
+  bool errored = false;
+
   // 2. Parsear
   enum auth_state st = auth_consume(&s->read_buffer, &s->auth_parser, &errored);
 
   if (auth_is_done(st, &errored)) {
-    // 3. Validar Usuario y guardar resultado
-    s->auth_success = validate_credentials(s);
-    uint8_t status = s->auth_success ? AUTH_SUCCESS : AUTH_FAILURE;
-
-    printf("Auth for fd %d: user='%s' -> %s\n", key->fd,
-           s->credentials.username, s->auth_success ? "SUCCESS" : "FAILURE");
+    s->phase_at = latency_clock();
+    // 3. Validar Usuario. El KDF no corre en el selector: salvo que la
+    // verificación esté en caché, se delega al pool. Un usuario inexistente
+    // también pasa por el pool, para tardar lo mismo
+    user_verifier v;
+    bool exists = get_user_verifier(s->credentials.username, &v);
+    if (exists && cached_credentials(s->credentials.username, &v,
+                                     s->credentials.password)) {
+      return auth_reply(key, true);
+    }
 
-    // Preparar respuesta
-    if (-1 == auth_marshall(&s->write_buffer, status))
+    s->auth_job = auth_verify_start(key->s, key->fd, exists ? &v : NULL,
+                                    s->credentials.password);
+    if (s->auth_job == NULL)
       return ERROR;
 
-    return on_auth_write(key);
+    selector_set_interest_key(key, OP_NOOP);
+    return AUTH_VERIFY;
   }
   if (errored)
     return ERROR;
   return AUTH_READ;
 }
 
+static unsigned on_auth_verify(struct selector_key *key) {
+  client_t *s = key->data;
+  bool success;
+
+  // Notificación vieja dirigida a una sesión anterior con el mismo fd
+  if (s->auth_job == NULL || !auth_verify_done(s->auth_job, &success)) {
+    return AUTH_VERIFY;
+  }
+  if (success) {
+    success = auth_verify_accept(s->auth_job, s->credentials.username,
+                                 s->credentials.password);
+  }
+  auth_verify_release(s->auth_job);
+  s->auth_job = NULL;
+
+  return auth_reply(key, success);
+}
+
 static unsigned on_auth_write(struct selector_key *key) {
   client_t *s = key->data;
   size_t nbyte;
@@ -241,14 +327,71 @@ static unsigned on_auth_write(struct selector_key *key) {
   if (s->auth_success) {
     printf("Successful auth, moving to REQUEST_READ for fd %d (user= %s)\n",
            key->fd, s->credentials.username);
-    selector_set_interest(key->s, key->fd, OP_READ);
-    return REQUEST_READ;
+    return request_start(key);
   } else {
     printf("Failed auth, closing connection for fd %d\n", key->fd);
     return ERROR; // Auth fallida = cerrar conexión
   }
 }
 
+// Abre el socket al origen y arranca el connect no bloqueante. Si el cliente
+// mandó datos detrás del pedido sin esperar la respuesta, pedimos TCP Fast
+// Open: con cookie del origen el connect se difiere y los datos viajan en el
+// SYN; sin cookie el kernel la pide en este handshake y los datos salen
+// después, por la copia normal.
+// Retorna -1 si falló (con errno), o 0 con `origin_fd' esperando a conectar.
+static int origin_connect(client_t *s) {
+  s->phase_at = latency_clock();
+  int fd = socket(s->origin_domain, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (selector_fd_set_nio(fd) == -1) {
+    goto fail;
+  }
+  sockopts_apply(fd, LEG_ORIGIN);
+
+  s->tfo_attempt = false;
+  if (buffer_can_read(&s->read_buffer)) {
+    int on = 1;
+    s->tfo_attempt = setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on,
+                                sizeof(on)) == 0;
+  }
+
+  int ret = connect(fd, (struct sockaddr *)&s->origin_addr, s->origin_addr_len);
+  if (ret == 0 && s->tfo_attempt) {
+    size_t n;
+    uint8_t *ptr = buffer_read_ptr(&s->read_buffer, &n);
+    ssize_t sent = send(fd, ptr, n, MSG_NOSIGNAL);
+    if (sent > 0) {
+      buffer_read_adv(&s->read_buffer, sent);
+    } else if (sent < 0 && errno != EINPROGRESS && errno != EAGAIN) {
+      goto fail;
+    }
+  } else if (ret < 0 && errno != EINPROGRESS) {
+    goto fail;
+  }
+  s->origin_fd = fd;
+  return 0;
+
+fail: {
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return -1;
+}
+}
+
+// El origen terminó el handshake de un connect con Fast Open: vemos si
+// aceptó los datos del SYN
+static void tfo_account(int fd) {
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+    tfo_connect_result((info.tcpi_options & TCPI_OPT_SYN_DATA) != 0);
+  }
+}
+
 static unsigned process_request(struct selector_key *key) {
   client_t *s = key->data;
   request_parser *p = &s->request_parser;
@@ -297,12 +440,23 @@ static unsigned process_request(struct selector_key *key) {
   }
 
   case ATYP_DOMAIN: {
-    struct selector_key *k = malloc(sizeof(*k));
-    *k = *key;
+    // Literales IP y hosts estáticos no necesitan resolvedor
+    if (dns_static_lookup((const char *)p->addr, p->port, &s->origin_addr,
+                          &s->origin_addr_len, &s->origin_domain)) {
+      break;
+    }
+    if (dns_cache_lookup((const char *)p->addr, p->port, &s->origin_addr,
+                         &s->origin_addr_len, &s->origin_domain)) {
+      break; // respuesta en caché: conectamos directo
+    }
 
-    pthread_t tid;
-    pthread_create(&tid, NULL, dns_resolve, k);
-    pthread_detach(tid);
+    // Si ya hay una resolución en vuelo para el mismo host nos suscribimos a
+    // ella en lugar de lanzar otra
+    s->phase_at = latency_clock();
+    s->dns_query = dns_query_start(key->s, key->fd, (const char *)p->addr);
+    if (s->dns_query == NULL) {
+      return ERROR;
+    }
 
     selector_set_interest(key->s, key->fd, OP_NOOP);
     return REQUEST_RESOLVE;
@@ -312,59 +466,42 @@ static unsigned process_request(struct selector_key *key) {
     return ERROR; // Tipo no soportado
   }
 
-  s->origin_fd = socket(s->origin_domain, SOCK_STREAM, 0);
-  if (s->origin_fd == -1) {
-    return ERROR; // O request_write_error(key, 0x01);
-  }
-
-  if (selector_fd_set_nio(s->origin_fd) == -1) {
-    close(s->origin_fd);
-    return ERROR;
-  }
-
-  int ret = connect(s->origin_fd, (struct sockaddr *)&s->origin_addr, s->origin_addr_len);
-
-  if (ret == -1) {
-    if (errno == EINPROGRESS) {
-      // Conexión en curso: Registramos el origen en el selector
-      selector_status ss = selector_register(
-          key->s, s->origin_fd, get_session_handler(), OP_WRITE, s);
-      if (ss != SELECTOR_SUCCESS) {
-        close(s->origin_fd);
-        return ERROR;
-      }
-      s->references++; // Incrementamos referencias porque ahora hay dos FDs apuntando a s
-      // Pausamos lectura del cliente
-      selector_set_interest_key(key, OP_NOOP);
-
-      return REQUEST_CONNECT; // Vamos a esperar a que conecte
+  if (origin_connect(s) == 0) {
+    // Conexión en curso: Registramos el origen en el selector
+    selector_status ss = selector_register(
+        key->s, s->origin_fd, get_session_handler(), OP_WRITE, s);
+    if (ss != SELECTOR_SUCCESS) {
+      close(s->origin_fd);
+      s->origin_fd = -1;
+      return ERROR;
     }
+    s->references++; // Incrementamos referencias porque ahora hay dos FDs apuntando a s
+    // Pausamos lectura del cliente
+    selector_set_interest_key(key, OP_NOOP);
 
-    // Falló connect inmediato - enviar error apropiado
-    int saved_errno = errno;
-    close(s->origin_fd);
-    s->origin_fd = -1;
+    return REQUEST_CONNECT; // Vamos a esperar a que conecte
+  }
 
-    // Preparar respuesta de error
-    request_reply reply = {
-        .version = SOCKS5_VERSION,
-        .status = (saved_errno == ENETUNREACH || saved_errno == EHOSTUNREACH)
-                      ? HOST_UNREACHABLE // 0x04
-                      : GRAL_FAILURE,    // 0x01
-        .bnd.atyp = ATYP_IPV4,
-        .bnd.addr = {0},
-        .bnd.port = 0};
+  // Falló connect inmediato - enviar error apropiado
+  int saved_errno = errno;
 
-    if (-1 == request_marshall(&s->write_buffer, &reply)) {
-      return ERROR;
-    }
+  // Preparar respuesta de error
+  request_reply reply = {
+      .version = SOCKS5_VERSION,
+      .status = (saved_errno == ENETUNREACH || saved_errno == EHOSTUNREACH)
+                    ? HOST_UNREACHABLE // 0x04
+                    : GRAL_FAILURE,    // 0x01
+      .bnd.atyp = ATYP_IPV4,
+      .bnd.addr = {0},
+      .bnd.port = 0};
 
-    s->close_after_write = true;
-    selector_set_interest_key(key, OP_WRITE);
-    return REQUEST_WRITE;
+  if (-1 == request_marshall(&s->write_buffer, &reply)) {
+    return ERROR;
   }
 
-  return REQUEST_CONNECT; // Dejamos que el selector nos avise WRITE igual para simplificar
+  s->close_after_write = true;
+  selector_set_interest_key(key, OP_WRITE);
+  return REQUEST_WRITE;
 }
 
 static void log_connection(client_t *s, const char *status) {
@@ -380,6 +517,10 @@ static void log_connection(client_t *s, const char *status) {
 
   sockaddr_to_human(dst_addr, sizeof(dst_addr), (struct sockaddr *)&s->origin_addr);
   log_access(s->credentials.username, src_addr, dst_addr, status);
+
+  char destination[TOPK_KEY_MAX];
+  socks5_destination(s, destination, sizeof(destination));
+  uniques_destination(destination);
 }
 
 static unsigned request_connect_success(struct selector_key *key) {
@@ -421,8 +562,13 @@ static unsigned request_connect_done(struct selector_key *key) {
   // Chequeamos si conectó
   if (getsockopt(key->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
     error = errno;
+  latency_record(LATENCY_CONNECT, s->phase_at);
 
   if (error == 0) {
+    if (s->tfo_attempt) {
+      tfo_account(key->fd);
+    }
+    s->phase_at = latency_clock(); // desde acá se mide el primer byte
     return request_connect_success(key);
   } else {
     // Falló: enviar error apropiado al cliente
@@ -452,12 +598,132 @@ static unsigned request_connect_done(struct selector_key *key) {
 
 static size_t current_buffer_size = DEFAULT_BUFFER_SIZE;
 
+// Destino tal como lo pidió el cliente: el nombre si vino un dominio (varias
+// direcciones son el mismo destino), si no la dirección. El nombre puede
+// traer cualquier byte y termina en respuestas de management de una línea
+// por entrada con campos `clave=valor': los bytes no imprimibles, el
+// espacio, `=' y `%' van como %XX
+void socks5_destination(client_t *s, char *out, size_t size) {
+  request_parser *p = &s->request_parser;
+  if (p->atyp == ATYP_DOMAIN) {
+    size_t pos = 0;
+    for (const uint8_t *c = p->addr; *c != '\0' && pos + 4 < size; c++) {
+      if (*c <= ' ' || *c >= 0x7f || *c == '=' || *c == '%') {
+        pos += snprintf(out + pos, size - pos, "%%%02X", *c);
+      } else {
+        out[pos++] = *c;
+      }
+    }
+    snprintf(out + pos, size - pos, ":%u", p->port);
+  } else {
+    sockaddr_to_human(out, size, (struct sockaddr *)&s->origin_addr);
+  }
+}
+
+static void destination_flush(client_t *s) {
+  if (s->dest_pending == 0) {
+    return;
+  }
+  char key[TOPK_KEY_MAX];
+  socks5_destination(s, key, sizeof(key));
+  destinations_charge(key, s->dest_pending);
+  s->dest_pending = 0;
+}
+
+void socks5_close(client_t *s) {
+  destination_flush(s);
+  if (s->stm.current != NULL && s->stm.current->state == ERROR) {
+    accounts_failed(s->account);
+    session_error();
+  }
+}
+
 void configure_buffer_size(size_t size) {
   if (size > 0 && size <= MAX_CONFIGURABLE_BUFFER && size <= BUFFER_SIZE) {
     current_buffer_size = size;
   }
 }
 
+// Recalcula los intereses de los dos extremos de la copia: se lee de un
+// extremo abierto si hay lugar en su buffer destino y el usuario tiene cupo,
+// y se escribe si hay datos pendientes para él.
+static void copy_interests(fd_selector sel, client_t *s) {
+  bool throttled = s->throttle.parked || s->sched.parked;
+  fd_interest client = OP_NOOP, origin = OP_NOOP;
+
+  if (!s->client_closed && !throttled && buffer_can_write(&s->read_buffer))
+    client |= OP_READ;
+  if (buffer_can_read(&s->write_buffer))
+    client |= OP_WRITE;
+  if (!s->origin_closed && !throttled && buffer_can_write(&s->write_buffer))
+    origin |= OP_READ;
+  if (buffer_can_read(&s->read_buffer))
+    origin |= OP_WRITE;
+
+  selector_set_interest(sel, s->client_fd, client);
+  selector_set_interest(sel, s->origin_fd, origin);
+  s->syscalls.interests += 2;
+}
+
+// La cuenta del usuario volvió a tener cupo
+static void copy_resume(struct account_waiter *w, fd_selector sel) {
+  client_t *s = (client_t *)((char *)w - offsetof(client_t, throttle));
+  if (s->stm.current != NULL && s->stm.current->state == COPY) {
+    copy_interests(sel, s);
+  }
+}
+
+// El scheduler le asignó cupo a la sesión en esta ronda
+static void copy_sched_resume(struct sched_entry *e, fd_selector sel) {
+  client_t *s = (client_t *)((char *)e - offsetof(client_t, sched));
+  if (s->stm.current != NULL && s->stm.current->state == COPY) {
+    copy_interests(sel, s);
+  }
+}
+
+/** bytes sin enviar que admite el kernel en los sockets de sesiones masivas */
+#define FLOW_BULK_NOTSENT_LOWAT (128 * 1024)
+
+// Ajusta los sockets y el despacho de la sesión a su clase: las
+// interactivas van sin Nagle y se atienden primero en cada iteración; las
+// masivas dejan poco backlog sin enviar en el kernel, así lo que escriben no
+// se encola delante de las interactivas y la contrapresión llega antes.
+static void flow_apply(fd_selector sel, client_t *s) {
+  bool interactive = s->flow.class == FLOW_INTERACTIVE;
+  int nodelay = interactive ? 1 : 0;
+  // 0 vuelve al valor del sistema
+  int lowat = interactive ? 0 : FLOW_BULK_NOTSENT_LOWAT;
+  int fds[] = {[LEG_CLIENT] = s->client_fd, [LEG_ORIGIN] = s->origin_fd};
+
+  for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+    if (fds[i] < 0) {
+      continue;
+    }
+    // lo fijado en el perfil del extremo no se toca
+    const struct sock_profile *p = sockopts_profile(i);
+    if (p->nodelay == SOCKOPT_DEFAULT) {
+      setsockopt(fds[i], IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+    if (p->notsent_lowat == SOCKOPT_DEFAULT) {
+      setsockopt(fds[i], IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+                 sizeof(lowat));
+    }
+    selector_set_priority(sel, fds[i], interactive);
+  }
+  s->sched.interactive = interactive;
+}
+
+static void copy_init(const unsigned state, struct selector_key *key) {
+  (void)state;
+  client_t *s = key->data;
+  if (s->handshaking) {
+    s->handshaking = false;
+    admission_handshake_done();
+  }
+  flow_init(&s->flow);
+  flow_apply(key->s, s);
+}
+
 static unsigned copy_read(struct selector_key *key) {
   client_t *s = key->data;
   int fd = key->fd;
@@ -471,14 +737,36 @@ static unsigned copy_read(struct selector_key *key) {
   size_t space;
 
   uint8_t *dst = buffer_write_ptr(buffer, &space);
-  // limitar read size a current_buffer_size
-  if (space > current_buffer_size) {
-    space = current_buffer_size;
+  // limitar read size a current_buffer_size; las masivas leen de a buffers
+  // completos para hacer menos syscalls por byte
+  size_t chunk = s->flow.class == FLOW_BULK ? BUFFER_SIZE : current_buffer_size;
+  if (space > chunk) {
+    space = chunk;
+  }
+  // y a lo que le queda al usuario en su bucket: sin cupo, no leemos y
+  // esperamos a que el timer de la cuenta nos despierte...
+  space = accounts_allowance(s->account, space);
+  if (space == 0) {
+    accounts_park(s->account, &s->throttle, key->s);
+    copy_interests(key->s, s);
+    return COPY;
+  }
+  // ...y a lo que le toque en el reparto de la capacidad global
+  space = sched_allowance(&s->sched, space);
+  if (space == 0) {
+    s->sched.weight = accounts_weight(s->account);
+    sched_park(&s->sched, key->s);
+    copy_interests(key->s, s);
+    return COPY;
   }
   ssize_t n = recv(fd, dst, space, 0);
+  bool would_block = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  s->syscalls.recvs++;
+  s->syscalls.eagains += would_block;
+  copy_recv_call(would_block);
 
   if (n < 0) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    if (would_block) {
       return s->stm.current->state;
     }
     perror("COPY recv");
@@ -493,19 +781,39 @@ static unsigned copy_read(struct selector_key *key) {
       printf("COPY: ORIGIN closed the conection.\n");
     }
 
-    selector_set_interest(key->s, key->fd, OP_NOOP);
     if (!buffer_can_read(buffer)) {
       return DONE;
     }
-    selector_set_interest(key->s, origin_fd, OP_WRITE);
+    copy_interests(key->s, s);
     return COPY;
   }
 
   buffer_write_adv(buffer, n);
+  // el kernel apaga TCP_QUICKACK por su cuenta: lo rearmamos en cada lectura
+  sockopts_rearm(fd, is_client_fd ? LEG_CLIENT : LEG_ORIGIN);
+  if (!is_client_fd && !s->origin_replied) {
+    s->origin_replied = true;
+    latency_record(LATENCY_FIRST_BYTE, s->phase_at);
+  }
   transfer_bytes(n);
+  accounts_charge(s->account, n, is_client_fd);
+  if (is_client_fd) {
+    s->bytes_up += n;
+  } else {
+    s->bytes_down += n;
+  }
+  s->dest_pending += n;
+  if (s->dest_pending >= DEST_FLUSH_BYTES) {
+    destination_flush(s);
+  }
+  sched_charge(&s->sched, n);
+  if (flow_observe(&s->flow, n)) {
+    printf("COPY: fd %d is now %s\n", s->client_fd,
+           flow_class_name(s->flow.class));
+    flow_apply(key->s, s);
+  }
 
-  selector_set_interest(key->s, origin_fd, OP_WRITE);
-  selector_set_interest_key(key, buffer_can_write(buffer) ? OP_READ : OP_NOOP);
+  copy_interests(key->s, s);
 
   // Intentamos escribir inmediatamente
   struct selector_key write_key = {
@@ -521,17 +829,19 @@ static unsigned copy_write(struct selector_key *key) {
   int fd = key->fd;
   bool is_client_fd = (fd == s->client_fd);
 
-  int origin_fd = is_client_fd ? s->origin_fd : s->client_fd;
-
   buffer *buffer = is_client_fd ? &s->write_buffer : &s->read_buffer;
 
   size_t to_send;
 
   uint8_t *src = buffer_read_ptr(buffer, &to_send);
   ssize_t sent = send(fd, src, to_send, MSG_NOSIGNAL);
+  bool would_block = sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  s->syscalls.sends++;
+  s->syscalls.eagains += would_block;
+  copy_send_call(would_block);
 
   if (sent <= 0) {
-    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    if (would_block) {
       return s->stm.current->state;
     }
     perror("COPY send");
@@ -540,16 +850,6 @@ static unsigned copy_write(struct selector_key *key) {
 
   buffer_read_adv(buffer, sent);
 
-  selector_set_interest(key->s, origin_fd, OP_READ);
-
-  unsigned interest = OP_READ;
-
-  if (buffer_can_read(buffer)) {
-    interest |= OP_WRITE;
-  }
-
-  selector_set_interest_key(key, interest);
-
   if (is_client_fd && !buffer_can_read(&s->write_buffer) &&
       s->stm.current->state == REQUEST_WRITE) {
     s->stm.current = &s->stm.states[COPY];
@@ -567,6 +867,7 @@ static unsigned copy_write(struct selector_key *key) {
     }
   }
 
+  copy_interests(key->s, s);
   return s->stm.current->state;
 }
 
@@ -588,6 +889,13 @@ static unsigned on_request_read(struct selector_key *key) {
   }
   buffer_write_adv(&s->read_buffer, ret);
 
+  return request_process(key);
+}
+
+// Parsea el pedido que haya en el buffer
+static unsigned request_process(struct selector_key *key) {
+  client_t *s = key->data;
+
   // 2. Alimentar al parser de Request
   bool errored = false;
   request_state st =
@@ -610,32 +918,16 @@ static unsigned on_request_read(struct selector_key *key) {
 }
 
 static unsigned init_connection_to_origin(client_t *s, struct selector_key *key) {
-  int fd = socket(s->origin_domain, SOCK_STREAM, 0);
-  if (fd < 0) {
-    perror("socket");
-    return ERROR;
-  }
-
-  // No bloqueante
-  if (selector_fd_set_nio(fd) == -1) {
-    close(fd);
-    return ERROR;
-  }
-
-  s->origin_fd = fd;
-
-  int ret = connect(fd, (struct sockaddr *)&s->origin_addr, s->origin_addr_len);
-  if (ret < 0 && errno != EINPROGRESS) {
-    close(fd);
-    s->origin_fd = -1;
+  if (origin_connect(s) == -1) {
+    perror("connect");
     return ERROR;
   }
 
   // Esperamos a que conecte
-  selector_status ss =
-      selector_register(key->s, fd, get_session_handler(), OP_WRITE, s);
+  selector_status ss = selector_register(key->s, s->origin_fd,
+                                         get_session_handler(), OP_WRITE, s);
   if (ss != SELECTOR_SUCCESS) {
-    close(fd);
+    close(s->origin_fd);
     s->origin_fd = -1;
     return ERROR;
   }
@@ -691,10 +983,19 @@ static unsigned on_request_write(struct selector_key *key) {
 static unsigned on_request_resolve(struct selector_key *key) {
   client_t *s = key->data;
 
-  struct addrinfo *res = s->res_addr;
-  struct addrinfo *p = res;
+  // Notificación vieja dirigida a una sesión anterior con el mismo fd
+  if (s->dns_query == NULL || !dns_query_done(s->dns_query)) {
+    return REQUEST_RESOLVE;
+  }
+
+  bool resolved =
+      dns_query_result(s->dns_query, s->request_parser.port, &s->origin_addr,
+                       &s->origin_addr_len, &s->origin_domain);
+  dns_query_release(s->dns_query);
+  s->dns_query = NULL;
+  latency_record(LATENCY_RESOLVE, s->phase_at);
 
-  if (p == NULL) {
+  if (!resolved) {
     // host unreachable
     printf("DNS: domain not resolved.\n");
 
@@ -710,22 +1011,11 @@ static unsigned on_request_resolve(struct selector_key *key) {
       return ERROR;
     }
 
+    s->close_after_write = true;
     selector_set_interest(key->s, key->fd, OP_WRITE);
     return REQUEST_WRITE;
   }
 
-  // Tomamos el primer resultado válido
-  s->current_res = p;
-
-  // Copiar dirección resuelta a s->origin_addr
-  memcpy(&s->origin_addr, p->ai_addr, p->ai_addrlen);
-  s->origin_addr_len = p->ai_addrlen;
-  s->origin_domain = p->ai_family;
-
-  // Liberar lista completa
-  freeaddrinfo(res);
-  s->res_addr = NULL;
-
   // Ahora conectar
   return init_connection_to_origin(s, key);
 }
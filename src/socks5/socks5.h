@@ -7,9 +7,14 @@
 #define GRAL_FAILURE 0x01
 #define HOST_UNREACHABLE 0x04
 
+#include "accounts.h"
 #include "auth.h"
+#include "auth_verify.h"
+#include "dns.h"
+#include "flowclass.h"
 #include "hello.h"
 #include "request.h"
+#include "scheduler.h"
 #include "stm.h"
 #include <netinet/in.h>
 #include <pthread.h>
@@ -43,6 +48,20 @@ typedef enum socks_v5state {
    */
   HELLO_WRITE,
   AUTH_READ,
+
+  /**
+   * espera que el pool verificador termine de correr el KDF sobre las
+   * credenciales recibidas.
+   *
+   * Intereses:
+   *     - OP_NOOP sobre client_fd (se despierta por notificación de bloqueo)
+   *
+   * Transiciones:
+   *   - AUTH_VERIFY mientras la verificación no terminó
+   *   - AUTH_WRITE  con la respuesta armada
+   *   - ERROR       ante cualquier error
+   */
+  AUTH_VERIFY,
   AUTH_WRITE,
   REQUEST_READ,
   REQUEST_WRITE,
@@ -91,6 +110,27 @@ typedef struct client_s {
   struct auth_parser auth_parser;
   auth_credentials credentials; // aca guardamos user/pass recibidos
   bool auth_success;            // resultado de la validación de credenciales
+  const char *trusted;          // identidad si viene de una red de confianza
+  struct account *account;      // cuenta cobrada (NULL si es anónima)
+  struct account_waiter throttle; // espera de cupo de la cuenta en COPY
+  struct sched_entry sched;       // reparto de la capacidad global en COPY
+  struct flow_profile flow;       // clase de la sesión en COPY
+  bool tfo_attempt;               // el connect al origen pidió Fast Open
+  bool handshaking;               // todavía no llegó a COPY
+  uint64_t accepted_at;           // latency_clock() del accept
+  uint64_t phase_at;              // comienzo de la etapa que se está midiendo
+  bool origin_replied;            // ya llegó el primer byte del origen
+  uint64_t dest_pending;          // bytes copiados sin sumar al destino
+  uint64_t bytes_up, bytes_down;  // copiados en cada sentido
+  struct {
+    uint64_t recvs, sends;        // syscalls de la etapa de copia...
+    uint64_t eagains;             // ...que volvieron sin nada que hacer
+    uint64_t interests;           // cambios de interés pedidos al selector
+  } syscalls;
+  uint64_t id;                    // identificador en el registro de sesiones
+  unsigned census_state;          // estado en el que está contada
+  struct client_s *prev_session, *next_session; // registro de sesiones
+  struct auth_job *auth_job;    // verificación en curso en el pool
 
   request_parser request_parser;
 
@@ -111,12 +151,15 @@ typedef struct client_s {
   // origin_fd
   int references;
 
-  // ACA
-  struct addrinfo *res_addr;
-  struct addrinfo *current_res;
+  // resolución de nombres en curso (ATYP_DOMAIN), compartida entre sesiones
+  struct dns_query *dns_query;
 } client_t;
 
 void socks5_init(client_t *s);
+/** cierre de la sesión: contabiliza lo que quedó pendiente */
+void socks5_close(client_t *s);
+/** destino pedido por el cliente (nombre:puerto o dirección:puerto) */
+void socks5_destination(client_t *s, char *out, size_t size);
 void configure_buffer_size(size_t size);
 const struct fd_handler *get_socks5_handler(void);
 
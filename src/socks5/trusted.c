@@ -0,0 +1,109 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trusted.h"
+
+struct trusted_net {
+  int family;
+  uint8_t addr[16];
+  unsigned prefix;
+  char name[256]; // como el username de RFC 1929
+};
+
+static struct trusted_net nets[MAX_TRUSTED_NETWORKS];
+static size_t net_count = 0;
+
+// Compara los primeros `prefix' bits
+static bool prefix_match(const uint8_t *a, const uint8_t *b, unsigned prefix) {
+  unsigned bytes = prefix / 8, bits = prefix % 8;
+  if (memcmp(a, b, bytes) != 0) {
+    return false;
+  }
+  if (bits == 0) {
+    return true;
+  }
+  uint8_t mask = (uint8_t)(0xFF << (8 - bits));
+  return (a[bytes] & mask) == (b[bytes] & mask);
+}
+
+bool trusted_add(const char *spec) {
+  if (spec == NULL || net_count == MAX_TRUSTED_NETWORKS) {
+    return false;
+  }
+  char copy[INET6_ADDRSTRLEN + 4 + sizeof(nets[0].name)];
+  if (strlen(spec) >= sizeof(copy)) {
+    return false;
+  }
+  strcpy(copy, spec);
+
+  struct trusted_net *n = nets + net_count;
+  memset(n, 0, sizeof(*n));
+  char *name = strchr(copy, '=');
+  if (name != NULL) {
+    *name++ = '\0';
+    if (*name == '\0' || strlen(name) >= sizeof(n->name)) {
+      return false;
+    }
+    strcpy(n->name, name);
+  } else {
+    strcpy(n->name, TRUSTED_DEFAULT_NAME);
+  }
+
+  char *slash = strchr(copy, '/');
+  if (slash != NULL) {
+    *slash++ = '\0';
+  }
+  if (inet_pton(AF_INET, copy, n->addr) == 1) {
+    n->family = AF_INET;
+  } else if (inet_pton(AF_INET6, copy, n->addr) == 1) {
+    n->family = AF_INET6;
+  } else {
+    return false;
+  }
+  unsigned max = n->family == AF_INET ? 32 : 128;
+  n->prefix = max;
+  if (slash != NULL) {
+    char *end;
+    long prefix = strtol(slash, &end, 10);
+    if (end == slash || *end != '\0' || prefix < 0 || prefix > (long)max) {
+      return false;
+    }
+    n->prefix = prefix;
+  }
+
+  net_count++;
+  return true;
+}
+
+const char *trusted_match(const struct sockaddr *addr) {
+  if (net_count == 0 || addr == NULL) {
+    return NULL;
+  }
+  int family = addr->sa_family;
+  const uint8_t *bytes;
+  if (family == AF_INET) {
+    bytes = (const uint8_t *)&((const struct sockaddr_in *)addr)->sin_addr;
+  } else if (family == AF_INET6) {
+    const struct in6_addr *a6 = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+    bytes = a6->s6_addr;
+    // el listener es dual stack: los clientes IPv4 llegan como ::ffff:a.b.c.d
+    if (IN6_IS_ADDR_V4MAPPED(a6)) {
+      family = AF_INET;
+      bytes += 12;
+    }
+  } else {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < net_count; i++) {
+    if (nets[i].family == family &&
+        prefix_match(nets[i].addr, bytes, nets[i].prefix)) {
+      return nets[i].name;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef TRUSTED_H
+#define TRUSTED_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/**
+ * trusted.c - redes de confianza
+ *
+ * Los clientes cuya dirección cae en alguna de estas redes pueden negociar
+ * NO_AUTH aunque ofrezcan usuario/contraseña, ahorrando el ida y vuelta de
+ * RFC 1929. La sesión queda identificada con el nombre sintético de la red
+ * para logs y contabilidad.
+ *
+ * La tabla se arma al arrancar y después sólo se lee desde el hilo del
+ * selector.
+ */
+#define MAX_TRUSTED_NETWORKS 16
+/** identidad de las redes que no especifican una */
+#define TRUSTED_DEFAULT_NAME "trusted"
+
+/**
+ * Agrega una red con formato `<addr>/<prefijo>[=<nombre>]' (IPv4 o IPv6).
+ * Retorna false si el formato es inválido o no hay lugar.
+ */
+bool trusted_add(const char *spec);
+
+/**
+ * Retorna la identidad de la primera red que contiene a `addr', o NULL si no
+ * es de confianza. Las IPv4 mapeadas en IPv6 se comparan contra las redes
+ * IPv4.
+ */
+const char *trusted_match(const struct sockaddr *addr);
+
+#endif
@@ -0,0 +1,108 @@
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hll.h"
+#include "uniques.h"
+
+#define HOUR_MS 3600000ULL
+
+/** sketches de una dimensión */
+struct periods {
+  struct hll hour;      // hora en curso
+  struct hll last_hour; // hora anterior completa
+  struct hll day;       // día UTC en curso
+};
+
+static struct periods clients;
+static struct periods destinations;
+
+static uint64_t realtime_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** hora (desde la época) a la que corresponden los sketches `hour' */
+static uint64_t current_hour;
+
+// `consecutive' indica si la hora que cierra es la anterior a la nueva; si
+// el reloj saltó, lo que había no es la "hora anterior"
+static void rollover(struct periods *p, bool consecutive, bool new_day) {
+  if (consecutive) {
+    p->last_hour = p->hour;
+  } else {
+    hll_clear(&p->last_hour);
+  }
+  hll_clear(&p->hour);
+  if (new_day) {
+    hll_clear(&p->day);
+  }
+}
+
+// Alineado a las horas del reloj: el timer es monotónico y puede vencer un
+// poco antes del cambio de hora del reloj de pared, así que sólo rotamos si
+// la hora realmente cambió y reprogramamos para el inicio de la siguiente
+static void hour_tick(fd_selector s, void *data) {
+  (void)data;
+  uint64_t now = realtime_ms();
+  uint64_t hour = now / HOUR_MS;
+  if (hour != current_hour) {
+    bool consecutive = hour == current_hour + 1;
+    bool new_day = hour / 24 != current_hour / 24;
+    rollover(&clients, consecutive, new_day);
+    rollover(&destinations, consecutive, new_day);
+    current_hour = hour;
+  }
+  selector_timer_add(s, (hour + 1) * HOUR_MS - now, hour_tick, NULL);
+}
+
+bool uniques_init(fd_selector s) {
+  uint64_t now = realtime_ms();
+  current_hour = now / HOUR_MS;
+  return selector_timer_add(s, (current_hour + 1) * HOUR_MS - now, hour_tick,
+                            NULL) != 0;
+}
+
+static void add(struct periods *p, const void *data, size_t len) {
+  hll_add(&p->hour, data, len);
+  hll_add(&p->day, data, len);
+}
+
+void uniques_client(const struct sockaddr *addr) {
+  if (addr->sa_family == AF_INET) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    add(&clients, &in->sin_addr, sizeof(in->sin_addr));
+  } else if (addr->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+    add(&clients, &in6->sin6_addr, sizeof(in6->sin6_addr));
+  }
+}
+
+void uniques_destination(const char *destination) {
+  add(&destinations, destination, strlen(destination));
+}
+
+char *uniques_list(void) {
+  const struct {
+    const char *name;
+    const struct periods *p;
+  } dims[] = {{"clients", &clients}, {"destinations", &destinations}};
+  size_t size = 256;
+  char *out = malloc(size);
+  if (out == NULL) {
+    return NULL;
+  }
+  size_t pos = 0;
+  // Formato: dimensión hour=n last_hour=n day=n\r\n
+  for (size_t i = 0; i < sizeof(dims) / sizeof(dims[0]); i++) {
+    pos += snprintf(out + pos, size - pos,
+                    "%s hour=%llu last_hour=%llu day=%llu\r\n", dims[i].name,
+                    (unsigned long long)hll_count(&dims[i].p->hour),
+                    (unsigned long long)hll_count(&dims[i].p->last_hour),
+                    (unsigned long long)hll_count(&dims[i].p->day));
+  }
+  return out;
+}
@@ -0,0 +1,35 @@
+#ifndef UNIQUES_H
+#define UNIQUES_H
+
+#include "lib/selector.h"
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/**
+ * uniques.c - cantidad de clientes y destinos distintos
+ *
+ * Para dimensionar hace falta saber cuántas direcciones de clientes y
+ * cuántos destinos distintos se ven por hora. Guardar los conjuntos no
+ * escala: se estiman con sketches HyperLogLog (ver lib/hll.h) de la hora en
+ * curso, la hora anterior y el día UTC en curso. La memoria es fija (seis
+ * sketches) sin importar el tráfico.
+ *
+ * Sólo desde el hilo del selector.
+ */
+
+/** programa el cambio de hora */
+bool uniques_init(fd_selector s);
+
+/** cliente aceptado: cuenta su dirección, sin el puerto */
+void uniques_client(const struct sockaddr *addr);
+
+/** destino conectado, con la clave de TOP_DESTINATIONS */
+void uniques_destination(const char *destination);
+
+/**
+ * Una línea por dimensión con las estimaciones de cada período. El caller
+ * libera el string.
+ */
+char *uniques_list(void);
+
+#endif
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "management/statspage.h"
+
+/** intentos de copiar la página antes de rendirse */
+#define MAX_TRIES 1000
+/** una página sin actualizar por esta cantidad de intervalos es vieja */
+#define STALE_INTERVALS 20
+
+// Lee las métricas que el servidor publica en /dev/shm (ver statspage.h) sin
+// conectarse a él.
+static void usage(const char *progname) {
+  fprintf(stderr,
+          "Usage: %s [-i <ms>] <stats file> [metric]...\n"
+          "\n"
+          "   -i <ms>  Repite la lectura cada <ms> milisegundos.\n"
+          "\n"
+          "Sin métricas imprime todas. La página por defecto del servidor es\n"
+          "/dev/shm/socks5d-<SOCKS port>.stats (ver -S).\n"
+          "\n",
+          progname);
+  exit(1);
+}
+
+static uint64_t realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Lado lector del seqlock: copia la página entre dos lecturas iguales y
+// pares de `sequence'
+static bool snapshot(struct statspage *p, struct statspage *out) {
+  for (int i = 0; i < MAX_TRIES; i++) {
+    uint64_t before = atomic_load_explicit(&p->sequence, memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    out->updated_at = p->updated_at;
+    out->count = p->count;
+    if (out->count > STATSPAGE_ENTRIES) {
+      out->count = STATSPAGE_ENTRIES;
+    }
+    for (uint32_t j = 0; j < out->count; j++) {
+      memcpy(out->entries[j].name, p->entries[j].name,
+             sizeof(out->entries[j].name));
+      out->entries[j].kind = p->entries[j].kind;
+      out->entries[j].value = atomic_load_explicit(&p->entries[j].value,
+                                                   memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&p->sequence, memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool wanted(const char *name, char **metrics, int n) {
+  if (n == 0) {
+    return true;
+  }
+  for (int i = 0; i < n; i++) {
+    if (strcmp(name, metrics[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static struct statspage *open_page(const char *path) {
+  struct statspage *page = NULL;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*page)) {
+    fprintf(stderr, "%s: not a stats page\n", path);
+    goto finally;
+  }
+  // PROT_READ alcanza: el lector nunca escribe, ni siquiera `sequence'
+  void *map = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    goto finally;
+  }
+  page = map;
+  if (memcmp(page->magic, STATSPAGE_MAGIC, sizeof(page->magic)) != 0 ||
+      page->version != STATSPAGE_VERSION ||
+      page->entry_size != sizeof(struct statspage_entry)) {
+    fprintf(stderr, "%s: not a stats page or unsupported version\n", path);
+    munmap(map, sizeof(*page));
+    page = NULL;
+  }
+finally:
+  close(fd);
+  return page;
+}
+
+int main(int argc, char *argv[]) {
+  long interval = 0;
+  int c;
+  while ((c = getopt(argc, argv, "hi:")) != -1) {
+    switch (c) {
+    case 'i': {
+      char *end;
+      errno = 0;
+      interval = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || errno == ERANGE || interval < 1 ||
+          interval > INT_MAX / 1000) {
+        fprintf(stderr, "invalid interval: %s\n", optarg);
+        return 1;
+      }
+      break;
+    }
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+  }
+
+  struct statspage *page = open_page(argv[optind]);
+  if (page == NULL) {
+    return 1;
+  }
+  char **metrics = argv + optind + 1;
+  int nmetrics = argc - optind - 1;
+
+  static struct statspage copy;
+  do {
+    if (!snapshot(page, &copy)) {
+      fprintf(stderr, "could not get a consistent snapshot\n");
+      return 1;
+    }
+    uint64_t age_ms = (realtime_ns() - copy.updated_at) / 1000000;
+    if (age_ms > (uint64_t)page->interval_ms * STALE_INTERVALS) {
+      fprintf(stderr, "warning: page not updated for %llu ms (pid %u)\n",
+              (unsigned long long)age_ms, page->pid);
+    }
+    for (uint32_t i = 0; i < copy.count; i++) {
+      if (wanted(copy.entries[i].name, metrics, nmetrics)) {
+        printf("%s: %llu\n", copy.entries[i].name,
+               (unsigned long long)copy.entries[i].value);
+      }
+    }
+    if (interval > 0) {
+      printf("\n");
+      fflush(stdout);
+      struct timespec ts = {interval / 1000, (interval % 1000) * 1000000};
+      nanosleep(&ts, NULL);
+    }
+  } while (interval > 0);
+
+  munmap(page, sizeof(*page));
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <check.h>
+
+// asi se puede probar bucket_value, que es interna
+#include "histogram.c"
+
+START_TEST (test_histogram_exact_buckets) {
+    // los valores chicos tienen un bucket cada uno
+    for(uint64_t v = 0; v < HISTOGRAM_SUB_BUCKETS; v++) {
+        ck_assert_uint_eq(v, histogram_bucket(v));
+        ck_assert_uint_eq(v, bucket_value(v));
+    }
+    // la primera potencia de dos todavía tiene buckets de ancho 1
+    for(uint64_t v = HISTOGRAM_SUB_BUCKETS; v < 2 * HISTOGRAM_SUB_BUCKETS; v++) {
+        ck_assert_uint_eq(v, histogram_bucket(v));
+        ck_assert_uint_eq(v, bucket_value(histogram_bucket(v)));
+    }
+}
+END_TEST
+
+START_TEST (test_histogram_power_of_two_edges) {
+    for(unsigned bits = HISTOGRAM_SUB_BITS; bits < HISTOGRAM_MAX_BITS; bits++) {
+        uint64_t edge = 1ULL << bits;
+        unsigned first = HISTOGRAM_SUB_BUCKETS * (bits - HISTOGRAM_SUB_BITS + 1);
+        // 2^bits abre una potencia nueva, 2^bits - 1 cierra la anterior
+        ck_assert_uint_eq(first, histogram_bucket(edge));
+        ck_assert_uint_eq(first - 1, histogram_bucket(edge - 1));
+
+        // el valor representativo cae dentro del bucket y con error acotado
+        uint64_t width = edge >> HISTOGRAM_SUB_BITS;
+        uint64_t value = bucket_value(first);
+        ck_assert_uint_ge(value, edge);
+        ck_assert_uint_lt(value, edge + width);
+        ck_assert_uint_eq(first, histogram_bucket(value));
+        ck_assert_uint_le(value - edge, edge / HISTOGRAM_SUB_BUCKETS);
+    }
+}
+END_TEST
+
+START_TEST (test_histogram_saturation) {
+    unsigned last = HISTOGRAM_BUCKETS - 1;
+    ck_assert_uint_eq(last, histogram_bucket((1ULL << HISTOGRAM_MAX_BITS) - 1));
+    ck_assert_uint_eq(last, histogram_bucket(1ULL << HISTOGRAM_MAX_BITS));
+    ck_assert_uint_eq(last, histogram_bucket(1ULL << 50));
+    ck_assert_uint_eq(last, histogram_bucket(UINT64_MAX));
+
+    static struct histogram h;
+    histogram_record(&h, UINT64_MAX / 2);
+    ck_assert_uint_eq(1, h.counts[last]);
+    ck_assert_uint_eq(bucket_value(last), histogram_percentile(&h, 0.5));
+}
+END_TEST
+
+START_TEST (test_histogram_percentiles) {
+    static struct histogram h;
+    ck_assert_uint_eq(0, histogram_percentile(&h, 0.5));
+
+    // 1..100: hasta 63 los buckets son exactos, después de ancho 2
+    for(uint64_t v = 1; v <= 100; v++) {
+        histogram_record(&h, v);
+    }
+    ck_assert_uint_eq(100, histogram_count(&h));
+    ck_assert_uint_eq(5050, h.sum);
+    ck_assert_uint_eq(1, histogram_percentile(&h, 0));
+    ck_assert_uint_eq(25, histogram_percentile(&h, 0.25));
+    ck_assert_uint_eq(50, histogram_percentile(&h, 0.5));
+    ck_assert_uint_eq(99, histogram_percentile(&h, 0.99));
+    ck_assert_uint_eq(101, histogram_percentile(&h, 1));
+
+    // la copia da lo mismo
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = histogram_snapshot(&h, counts);
+    ck_assert_uint_eq(100, total);
+    ck_assert_uint_eq(50, histogram_snapshot_percentile(counts, total, 0.5));
+}
+END_TEST
+
+START_TEST (test_histogram_relative_error) {
+    static struct histogram h;
+    // un único valor grande: cualquier percentil lo aproxima a menos de
+    // 1/HISTOGRAM_SUB_BUCKETS
+    uint64_t value = 123456789;
+    histogram_record(&h, value);
+    uint64_t p = histogram_percentile(&h, 0.5);
+    uint64_t diff = p > value ? p - value : value - p;
+    ck_assert_uint_le(diff, value / HISTOGRAM_SUB_BUCKETS);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s   = suite_create("histogram");
+    TCase *tc  = tcase_create("histogram");
+
+    tcase_add_test(tc, test_histogram_exact_buckets);
+    tcase_add_test(tc, test_histogram_power_of_two_edges);
+    tcase_add_test(tc, test_histogram_saturation);
+    tcase_add_test(tc, test_histogram_percentiles);
+    tcase_add_test(tc, test_histogram_relative_error);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    SRunner *sr  = srunner_create(suite());
+    int number_failed;
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "hll.h"
+
+// error relativo típico de un sketch (ver hll.h)
+#define SIGMA (1.04 / sqrt(HLL_REGISTERS))
+
+static void
+add_range(struct hll *h, uint64_t from, uint64_t to) {
+    for(uint64_t i = from; i < to; i++) {
+        hll_add(h, &i, sizeof(i));
+    }
+}
+
+static double
+relative_error(uint64_t estimate, uint64_t real) {
+    return fabs((double)estimate - (double)real) / (double)real;
+}
+
+// estimación cruda de HyperLogLog, sin la corrección para pocos elementos
+static double
+raw_estimate(const struct hll *h, unsigned *zeros) {
+    const double m = HLL_REGISTERS;
+    double sum = 0;
+    *zeros = 0;
+    for(size_t i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -h->registers[i]);
+        *zeros += h->registers[i] == 0;
+    }
+    return 0.7213 / (1 + 1.079 / m) * m * m / sum;
+}
+
+START_TEST (test_hll_empty) {
+    static struct hll h;
+    hll_clear(&h);
+    ck_assert_uint_eq(0, hll_count(&h));
+
+    // repetir un elemento no suma
+    uint64_t x = 7;
+    for(int i = 0; i < 100; i++) {
+        hll_add(&h, &x, sizeof(x));
+    }
+    ck_assert_uint_eq(1, hll_count(&h));
+}
+END_TEST
+
+START_TEST (test_hll_linear_counting_switch) {
+    static struct hll h;
+    hll_clear(&h);
+    unsigned zeros;
+
+    // pocos elementos: con registros vacíos y estimación chica se usa el
+    // conteo lineal
+    add_range(&h, 0, 1000);
+    double raw = raw_estimate(&h, &zeros);
+    ck_assert(raw <= 2.5 * HLL_REGISTERS && zeros > 0);
+    double linear = HLL_REGISTERS * log((double)HLL_REGISTERS / zeros);
+    ck_assert_uint_eq((uint64_t)(linear + 0.5), hll_count(&h));
+
+    // muchos: ya no quedan registros vacíos y vale la estimación cruda
+    add_range(&h, 1000, 100000);
+    raw = raw_estimate(&h, &zeros);
+    ck_assert_uint_eq(0, zeros);
+    ck_assert_uint_eq((uint64_t)(raw + 0.5), hll_count(&h));
+}
+END_TEST
+
+START_TEST (test_hll_error) {
+    static struct hll h;
+    const uint64_t sizes[] = {1000, 100000};
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        hll_clear(&h);
+        add_range(&h, 0, sizes[i]);
+        ck_assert_msg(relative_error(hll_count(&h), sizes[i]) <= 3 * SIGMA,
+                      "%llu estimated as %llu\n",
+                      (unsigned long long)sizes[i],
+                      (unsigned long long)hll_count(&h));
+    }
+}
+END_TEST
+
+START_TEST (test_hll_merge) {
+    static struct hll a, b, both;
+    hll_clear(&a);
+    hll_clear(&b);
+    hll_clear(&both);
+
+    // se solapan en la mitad: la unión tiene 75000
+    add_range(&a, 0, 50000);
+    add_range(&b, 25000, 75000);
+    add_range(&both, 0, 75000);
+
+    hll_merge(&a, &b);
+    // la unión de sketches es el sketch de la unión
+    ck_assert_int_eq(0, memcmp(a.registers, both.registers, sizeof(a.registers)));
+    ck_assert(relative_error(hll_count(&a), 75000) <= 3 * SIGMA);
+
+    // unir con uno vacío o consigo mismo no cambia nada
+    static struct hll empty;
+    hll_clear(&empty);
+    hll_merge(&a, &empty);
+    hll_merge(&a, &both);
+    ck_assert_int_eq(0, memcmp(a.registers, both.registers, sizeof(a.registers)));
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s   = suite_create("hll");
+    TCase *tc  = tcase_create("hll");
+
+    tcase_add_test(tc, test_hll_empty);
+    tcase_add_test(tc, test_hll_linear_counting_switch);
+    tcase_add_test(tc, test_hll_error);
+    tcase_add_test(tc, test_hll_merge);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    SRunner *sr  = srunner_create(suite());
+    int number_failed;
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
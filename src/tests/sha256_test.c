@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "sha256.c"
+
+// Vectores de FIPS 180-2, RFC 4231 y RFC 7914 (sección 11)
+
+static void
+hex(const uint8_t *bytes, size_t len, char *out) {
+    for(size_t i = 0; i < len; i++) {
+        sprintf(out + 2 * i, "%02x", bytes[i]);
+    }
+}
+
+START_TEST (test_sha256_abc) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+    char out[2 * SHA256_DIGEST_LEN + 1];
+
+    sha256("abc", 3, digest);
+    hex(digest, sizeof(digest), out);
+    ck_assert_str_eq(
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", out);
+}
+END_TEST
+
+START_TEST (test_sha256_million_a) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+    char out[2 * SHA256_DIGEST_LEN + 1];
+    uint8_t chunk[1000];
+    memset(chunk, 'a', sizeof(chunk));
+
+    // de a pedazos que no coinciden con los bloques de 64 bytes
+    struct sha256_ctx ctx;
+    sha256_init(&ctx);
+    for(int i = 0; i < 1000; i++) {
+        sha256_update(&ctx, chunk, sizeof(chunk));
+    }
+    sha256_final(&ctx, digest);
+    hex(digest, sizeof(digest), out);
+    ck_assert_str_eq(
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", out);
+}
+END_TEST
+
+START_TEST (test_hmac_sha256) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+    char out[2 * SHA256_DIGEST_LEN + 1];
+    const char *data = "what do ya want for nothing?";
+
+    hmac_sha256((const uint8_t *)"Jefe", 4, data, strlen(data), digest);
+    hex(digest, sizeof(digest), out);
+    ck_assert_str_eq(
+        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", out);
+}
+END_TEST
+
+START_TEST (test_pbkdf2_sha256) {
+    uint8_t key[32];
+    char out[2 * sizeof(key) + 1];
+
+    pbkdf2_sha256((const uint8_t *)"password", 8, (const uint8_t *)"salt", 4,
+                  1, key, sizeof(key));
+    hex(key, sizeof(key), out);
+    ck_assert_str_eq(
+        "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b", out);
+
+    pbkdf2_sha256((const uint8_t *)"password", 8, (const uint8_t *)"salt", 4,
+                  4096, key, sizeof(key));
+    hex(key, sizeof(key), out);
+    ck_assert_str_eq(
+        "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a", out);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s   = suite_create("sha256");
+    TCase *tc  = tcase_create("sha256");
+
+    tcase_add_test(tc, test_sha256_abc);
+    tcase_add_test(tc, test_sha256_million_a);
+    tcase_add_test(tc, test_hmac_sha256);
+    tcase_add_test(tc, test_pbkdf2_sha256);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    SRunner *sr  = srunner_create(suite());
+    int number_failed;
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,165 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <check.h>
+
+// asi se puede revisar el heap interno
+#include "topk.c"
+
+#include "tests.h"
+
+// invariante del heap de mínimos y de las posiciones guardadas
+static bool
+heap_ok(topk t) {
+    for(size_t i = 0; i < t->used; i++) {
+        if(t->entries[t->heap[i]].slot != i) {
+            return false;
+        }
+        if(i > 0 && heap_weight(t, (i - 1) / 2) > heap_weight(t, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+START_TEST (test_topk_eviction) {
+    topk t = topk_new(3);
+    ck_assert_ptr_ne(NULL, t);
+
+    topk_add(t, "a", 5);
+    topk_add(t, "b", 3);
+    topk_add(t, "c", 1);
+    // tabla llena: "d" reemplaza a la más liviana y hereda su peso
+    topk_add(t, "d", 1);
+
+    struct topk_item items[4];
+    ck_assert_uint_eq(3, topk_list(t, items, N(items)));
+    ck_assert_str_eq("a", items[0].key);
+    ck_assert_uint_eq(5, items[0].weight);
+    ck_assert_uint_eq(0, items[0].error);
+    ck_assert_str_eq("b", items[1].key);
+    ck_assert_str_eq("d", items[2].key);
+    ck_assert_uint_eq(2, items[2].weight);
+    ck_assert_uint_eq(1, items[2].error);
+
+    // "c" ya no está: vuelve a entrar como nueva
+    topk_add(t, "c", 1);
+    ck_assert_uint_eq(3, topk_list(t, items, N(items)));
+    for(size_t i = 0; i < 3; i++) {
+        ck_assert_str_ne("d", items[i].key);
+    }
+    topk_destroy(t);
+}
+END_TEST
+
+START_TEST (test_topk_sift_down_after_update) {
+    topk t = topk_new(3);
+    topk_add(t, "a", 1);
+    topk_add(t, "b", 1);
+    topk_add(t, "c", 1);
+    // "a" sube de peso estando en la raíz: tiene que bajar
+    topk_add(t, "a", 10);
+    ck_assert(heap_ok(t));
+    ck_assert_str_ne("a", t->entries[t->heap[0]].key);
+
+    // la clave nueva desplaza a una de peso 1, nunca a "a"
+    topk_add(t, "d", 1);
+    ck_assert(heap_ok(t));
+    struct topk_item items[3];
+    ck_assert_uint_eq(3, topk_list(t, items, N(items)));
+    ck_assert_str_eq("a", items[0].key);
+    ck_assert_uint_eq(11, items[0].weight);
+    topk_destroy(t);
+}
+END_TEST
+
+START_TEST (test_topk_error_bound) {
+    enum { CAPACITY = 16, KEYS = 200 };
+    static uint64_t truth[KEYS];
+    char key[16];
+    uint64_t total = 0;
+
+    topk t = topk_new(CAPACITY);
+    // unas pocas claves pesadas mezcladas con muchas livianas
+    srand(42);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 4 == 0 ? rand() % 4 : 4 + rand() % (KEYS - 4);
+        uint64_t w = 1 + rand() % 3;
+        snprintf(key, sizeof(key), "k%d", k);
+        topk_add(t, key, w);
+        truth[k] += w;
+        total += w;
+        ck_assert(heap_ok(t));
+    }
+
+    struct topk_item items[CAPACITY];
+    size_t n = topk_list(t, items, N(items));
+    ck_assert_uint_eq(CAPACITY, n);
+    bool found[4] = {false};
+    for(size_t i = 0; i < n; i++) {
+        int k = atoi(items[i].key + 1);
+        // sobreestima en a lo sumo `error', que no pasa de total / capacidad
+        ck_assert_uint_ge(items[i].weight, truth[k]);
+        ck_assert_uint_le(items[i].weight - items[i].error, truth[k]);
+        ck_assert_uint_le(items[i].error, total / CAPACITY);
+        if(k < 4) {
+            found[k] = true;
+        }
+    }
+    // toda clave con más de total / capacidad está en la tabla
+    for(int k = 0; k < 4; k++) {
+        ck_assert(truth[k] <= total / CAPACITY || found[k]);
+    }
+    topk_destroy(t);
+}
+END_TEST
+
+START_TEST (test_topk_list_order) {
+    topk t = topk_new(8);
+    const char *keys[] = {"x", "y", "z", "w", "v"};
+    const uint64_t weights[] = {7, 30, 2, 15, 9};
+    for(size_t i = 0; i < N(keys); i++) {
+        topk_add(t, keys[i], weights[i]);
+    }
+
+    struct topk_item items[8];
+    size_t n = topk_list(t, items, N(items));
+    ck_assert_uint_eq(N(keys), n);
+    for(size_t i = 1; i < n; i++) {
+        ck_assert_uint_ge(items[i - 1].weight, items[i].weight);
+    }
+    ck_assert_str_eq("y", items[0].key);
+    ck_assert_str_eq("z", items[n - 1].key);
+
+    // `n' acota la copia y se queda con las más pesadas
+    ck_assert_uint_eq(2, topk_list(t, items, 2));
+    ck_assert_str_eq("y", items[0].key);
+    ck_assert_str_eq("w", items[1].key);
+    topk_destroy(t);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s   = suite_create("topk");
+    TCase *tc  = tcase_create("topk");
+
+    tcase_add_test(tc, test_topk_eviction);
+    tcase_add_test(tc, test_topk_sift_down_after_update);
+    tcase_add_test(tc, test_topk_error_bound);
+    tcase_add_test(tc, test_topk_list_order);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    SRunner *sr  = srunner_create(suite());
+    int number_failed;
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}